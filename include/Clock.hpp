@@ -38,6 +38,11 @@ namespace elapse {
 typedef std::int64_t TimeOffset;
 
 TimeUnit ToTimeUnit(std::time_t tm);
+// e.g. Cycle(ToTimeUnit(std::chrono::microseconds(250)), -1), truncated to the resolution
+template <class Rep, class Period>
+constexpr TimeUnit ToTimeUnit(std::chrono::duration<Rep, Period> duration) {
+	return static_cast<TimeUnit>(std::chrono::duration_cast<TimeUnitDuration>(duration).count());
+}
 
 class Clock {
 public:
@@ -45,7 +50,7 @@ public:
 	typedef std::chrono::time_point<clock_source> time_point;
 
 public:
-	Clock() : offsetInMillis_(0) {}
+	Clock() : offset_(0) {}
 	virtual ~Clock() {}
 
 	// get current clock time
@@ -54,9 +59,12 @@ public:
 	virtual time_point TimePoint() const;
 	// adjust clock with advance
 	virtual void Advance(TimeOffset delta);
+	// base time at which this clock reads `t`, max TimeUnit if it never will
+	virtual TimeUnit ToBaseTime(TimeUnit t) const { return t; }
 
 private:
-	TimeOffset offsetInMillis_;
+	// in time units
+	TimeOffset offset_;
 };
 
 template <class T>
@@ -72,9 +80,9 @@ public:
 	LazyClock() { Refresh(); }
 	virtual ~LazyClock() {}
 
-	virtual TimeUnit Now() const override;
-	virtual std::time_t NowTimeT() const override;
-	virtual time_point TimePoint() const override;
+	virtual TimeUnit Now() const override { return lazyNow_; }
+	virtual std::time_t NowTimeT() const override { return lazyTimeT_; }
+	virtual time_point TimePoint() const override { return lazyTimePoint_; }
 	virtual void Advance(TimeOffset delta) override;
 
 private:
@@ -86,4 +94,43 @@ private:
 	time_point lazyTimePoint_;
 };
 
+// LazyClock closed for extension, the default clock of StaticScheduler
+class StaticLazyClock final : public LazyClock {};
+
+// virtual clock running at its own offset and rate relative to a base clock.
+// a Scheduler driven by a DomainClock forms a clock domain: pausing, resuming
+// or rescaling it is O(1) and never touches the jobs scheduled inside.
+class DomainClock : public Clock {
+public:
+	explicit DomainClock(std::shared_ptr<Clock> base, double rate = 1.0);
+	virtual ~DomainClock() {}
+
+	virtual TimeUnit Now() const override;
+	virtual std::time_t NowTimeT() const override;
+	virtual time_point TimePoint() const override;
+	// shifts the domain time only
+	virtual void Advance(TimeOffset delta) override;
+	virtual TimeUnit ToBaseTime(TimeUnit t) const override;
+
+	void Pause();
+	void Resume();
+	bool IsPaused() const { return paused_; }
+	// rate 2.0 runs twice as fast as the base clock, 0 freezes the domain.
+	// negative rates freeze it as well
+	void SetRate(double rate);
+	double Rate() const { return rate_; }
+	std::shared_ptr<Clock> const& Base() const { return base_; }
+
+private:
+	// moves the anchor to the current base time
+	void Rebase();
+
+private:
+	std::shared_ptr<Clock> base_;
+	TimeUnit baseAnchor_;
+	TimeUnit domainAnchor_;
+	double rate_;
+	bool paused_;
+};
+
 } // namespace elapse
\ No newline at end of file
@@ -0,0 +1,220 @@
+#pragma once
+/*
+Author: ywx217@gmail.com
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#include <cstddef>
+#include <stdexcept>
+#include "Crontab.hpp"
+
+
+namespace elapse {
+namespace crontab {
+
+// compile-time crontab expressions.
+//
+// an expression holds 6 or 7 space separated fields:
+//   second minute hour day-of-month month day-of-week [year]
+// each field is a comma separated list of `*`, `?`, `N` or `N-M`, optionally
+// followed by `/step`; a stepped single value `N/step` runs up to the field max.
+// day-of-week accepts 0-7 with both 0 and 7 meaning sunday.
+//
+//   using namespace elapse::crontab::literals;
+//   constexpr CronSpec every5Minutes = "0 */5 * * * *"_cron;
+//
+// a malformed or never firing expression evaluated in a constant expression
+// fails to compile.
+
+enum class CronParseError {
+	None,
+	FieldCount,
+	EmptyField,
+	BadCharacter,
+	OutOfRange,
+	BadRange,
+	BadStep,
+	// well formed, but no date matches it (e.g. Feb 30)
+	NeverFires,
+};
+
+namespace detail {
+
+constexpr bool IsSpace(char c) {
+	return c == ' ' || c == '\t';
+}
+
+constexpr bool IsDigit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+// parses a decimal number at expr[pos], advancing pos
+constexpr CronParseError ParseNumber(const char* expr, std::size_t end, std::size_t& pos, std::size_t& value) {
+	if (pos >= end || !IsDigit(expr[pos])) {
+		return pos >= end ? CronParseError::EmptyField : CronParseError::BadCharacter;
+	}
+	value = 0;
+	for (; pos < end && IsDigit(expr[pos]); ++pos) {
+		value = value * 10 + static_cast<std::size_t>(expr[pos] - '0');
+		if (value > 10000) {
+			return CronParseError::OutOfRange;
+		}
+	}
+	return CronParseError::None;
+}
+
+// parses one field in expr[begin, end) into a mask covering values [lo, hi]
+template <class F>
+constexpr CronParseError ParseField(const char* expr, std::size_t begin, std::size_t end,
+			std::size_t lo, std::size_t hi, bool isDayOfWeek, F& field) {
+	if (begin >= end) {
+		return CronParseError::EmptyField;
+	}
+	std::size_t pos = begin;
+	while (true) {
+		std::size_t from = lo, to = hi, step = 1;
+		bool isSingle = false;
+		if (expr[pos] == '*' || expr[pos] == '?') {
+			++pos;
+		} else {
+			auto err = ParseNumber(expr, end, pos, from);
+			if (err != CronParseError::None) {
+				return err;
+			}
+			to = from;
+			isSingle = true;
+			if (pos < end && expr[pos] == '-') {
+				++pos;
+				err = ParseNumber(expr, end, pos, to);
+				if (err != CronParseError::None) {
+					return err;
+				}
+				isSingle = false;
+			}
+		}
+		if (pos < end && expr[pos] == '/') {
+			++pos;
+			auto err = ParseNumber(expr, end, pos, step);
+			if (err != CronParseError::None) {
+				return err;
+			}
+			if (step == 0) {
+				return CronParseError::BadStep;
+			}
+			if (isSingle) {
+				to = hi;
+			}
+		}
+		if (from < lo || to > hi) {
+			return CronParseError::OutOfRange;
+		}
+		if (from > to) {
+			return CronParseError::BadRange;
+		}
+		for (std::size_t v = from; v <= to; v += step) {
+			field.SetSingle(isDayOfWeek && v == 7 ? 0 : v);
+		}
+		if (pos == end) {
+			return CronParseError::None;
+		}
+		if (expr[pos] != ',') {
+			return CronParseError::BadCharacter;
+		}
+		++pos;
+		if (pos == end) {
+			return CronParseError::EmptyField;
+		}
+	}
+}
+
+} // namespace detail
+
+// parses a crontab expression into `spec`, never throws
+constexpr CronParseError TryParseCron(const char* expr, std::size_t length, CronSpec& spec) {
+	spec.ClearAll();
+	spec.Year().SetFitsAll();
+	std::size_t fields[7][2] = {};
+	std::size_t nFields = 0, pos = 0;
+	while (pos < length) {
+		while (pos < length && detail::IsSpace(expr[pos])) {
+			++pos;
+		}
+		if (pos == length) {
+			break;
+		}
+		if (nFields == 7) {
+			return CronParseError::FieldCount;
+		}
+		fields[nFields][0] = pos;
+		while (pos < length && !detail::IsSpace(expr[pos])) {
+			++pos;
+		}
+		fields[nFields][1] = pos;
+		++nFields;
+	}
+	if (nFields < 6) {
+		return CronParseError::FieldCount;
+	}
+
+	CronParseError err = CronParseError::None;
+	if ((err = detail::ParseField(expr, fields[0][0], fields[0][1], 0, 59, false, spec.Second())) != CronParseError::None ||
+		(err = detail::ParseField(expr, fields[1][0], fields[1][1], 0, 59, false, spec.Minute())) != CronParseError::None ||
+		(err = detail::ParseField(expr, fields[2][0], fields[2][1], 0, 23, false, spec.Hour())) != CronParseError::None ||
+		(err = detail::ParseField(expr, fields[3][0], fields[3][1], 1, 31, false, spec.DayOfMonth())) != CronParseError::None ||
+		(err = detail::ParseField(expr, fields[4][0], fields[4][1], 1, 12, false, spec.Month())) != CronParseError::None ||
+		(err = detail::ParseField(expr, fields[5][0], fields[5][1], 0, 7, true, spec.DayOfWeek())) != CronParseError::None) {
+		return err;
+	}
+	if (nFields == 7) {
+		spec.Year().Clear();
+		err = detail::ParseField(expr, fields[6][0], fields[6][1], 1970, 2099, false, spec.Year());
+	}
+	if (err == CronParseError::None && !spec.Feasible()) {
+		err = CronParseError::NeverFires;
+	}
+	return err;
+}
+
+// parses a crontab expression, throws std::invalid_argument on malformed input.
+// inside a constant expression the throw turns into a compile error.
+constexpr CronSpec ParseCron(const char* expr, std::size_t length) {
+	CronSpec spec;
+	if (TryParseCron(expr, length, spec) != CronParseError::None) {
+		throw std::invalid_argument("malformed crontab expression");
+	}
+	return spec;
+}
+
+namespace literals {
+
+constexpr CronSpec operator"" _cron(const char* expr, std::size_t length) {
+	return ParseCron(expr, length);
+}
+
+} // namespace literals
+
+} // namespace crontab
+} // namespace elapse
\ No newline at end of file
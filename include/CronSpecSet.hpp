@@ -0,0 +1,80 @@
+#pragma once
+/*
+Author: ywx217@gmail.com
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#include <cstdint>
+#include <ctime>
+#include <vector>
+#include "Crontab.hpp"
+
+
+namespace elapse {
+namespace crontab {
+
+// structure-of-arrays store of many crontab masks, evaluated in bulk.
+//
+// FindNext decomposes the reference time and every following day once for
+// the whole set. the day of month, month and day of week masks of a spec are
+// packed in one calendar word, so a day is tested against every spec with one
+// flat loop (SSE2 where available) yielding a bit per spec, and only the specs
+// that fit resolve their time of day. specs still pending after a year of
+// days, or landing on a day with a dst shift, fall back to CronSpec::FindNext.
+class CronSpecSet {
+public:
+	// index of the stored spec
+	std::size_t Add(CronSpec const& spec);
+	void Set(std::size_t idx, CronSpec const& spec);
+	CronSpec Get(std::size_t idx) const;
+	std::size_t Size() const { return second_.size(); }
+	void Reserve(std::size_t size);
+	void Clear();
+
+	// next firing strictly after `now` of every spec, 0 if a spec never fires again
+	void FindNext(std::time_t now, std::vector<std::time_t>& next) const;
+	// same as FindNext, in scheduler time units
+	void NextExpire(Clock const& clock, std::vector<TimeUnit>& next) const;
+
+protected:
+	struct Day;
+	// bits of the specs fitting `day`, for the words [begin, end) of `fits`
+	void FitDay(Day const& day, std::size_t begin, std::size_t end, std::vector<std::uint64_t>& fits) const;
+	void Fallback(std::size_t idx, std::time_t now, std::time_t& next) const;
+
+protected:
+	std::vector<SecondField::word_type> second_;
+	std::vector<MinuteField::word_type> minute_;
+	std::vector<HourField::word_type> hour_;
+	// day of month | month | day of week masks
+	std::vector<std::uint64_t> calendar_;
+	std::vector<YearField::word_type> year_[YearField::kWords];
+	// a bit per spec, set if the spec can fire at all
+	std::vector<std::uint64_t> feasible_;
+};
+
+} // namespace crontab
+} // namespace elapse
\ No newline at end of file
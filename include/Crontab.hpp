@@ -28,9 +28,12 @@ OTHER DEALINGS IN THE SOFTWARE.
 For more information, please refer to <http://unlicense.org>
 */
 #include <cstdint>
-#include <bitset>
 #include <ctime>
+#include <functional>
 #include <memory>
+#include <type_traits>
+#include <boost/blank.hpp>
+#include <boost/variant.hpp>
 #include "JobCommons.hpp"
 
 
@@ -44,61 +47,74 @@ template <std::size_t Bits, std::size_t BaseOffset = 0>
 class Field {
 public:
 	typedef Field<Bits, BaseOffset> MyTy;
+	// smallest unsigned word able to hold the mask, keeps fields packed
+	typedef typename std::conditional<(Bits <= 8), std::uint8_t,
+		typename std::conditional<(Bits <= 16), std::uint16_t,
+		typename std::conditional<(Bits <= 32), std::uint32_t, std::uint64_t>::type>::type>::type word_type;
+	static constexpr std::size_t kWordBits = sizeof(word_type) * 8;
+	static constexpr std::size_t kWords = (Bits + kWordBits - 1) / kWordBits;
+
 public:
-	Field() {}
-	virtual ~Field() {}
+	constexpr Field() : fits_{} {}
 
-	MyTy& SetFitsAll() {
-		fits_.set();
+	constexpr MyTy& SetFitsAll() {
+		for (std::size_t i = 0; i < kWords; ++i) {
+			fits_[i] = static_cast<word_type>(~word_type(0));
+		}
+		if (Bits % kWordBits) {
+			fits_[kWords - 1] = static_cast<word_type>((word_type(1) << (Bits % kWordBits)) - 1);
+		}
 		return *this;
 	}
 
-	MyTy& SetSingle(std::size_t idx) {
+	constexpr MyTy& SetSingle(std::size_t idx) {
 		if (idx < BaseOffset || idx - BaseOffset >= Bits) {
 			return *this;
 		}
-		fits_[idx - BaseOffset] = true;
+		Set(idx - BaseOffset);
 		return *this;
 	}
 
-	MyTy& SetRange(std::size_t from, std::size_t to) {
+	constexpr MyTy& SetRange(std::size_t from, std::size_t to) {
 		for (; from < to; ++from) {
 			if (from < BaseOffset || from - BaseOffset >= Bits) {
 				break;
 			}
-			fits_[from - BaseOffset] = true;
+			Set(from - BaseOffset);
 		}
 		return *this;
 	}
 
-	MyTy& Clear() {
-		fits_.reset();
+	constexpr MyTy& Clear() {
+		for (std::size_t i = 0; i < kWords; ++i) {
+			fits_[i] = 0;
+		}
 		return *this;
 	}
 
-	bool Fits(std::size_t idx) const {
+	constexpr bool Fits(std::size_t idx) const {
 		if (idx < BaseOffset || idx - BaseOffset >= Bits) {
 			return false;
 		}
-		return fits_[idx - BaseOffset];
+		return Test(idx - BaseOffset);
 	}
 
-	bool NextFit(int idx, int& result) const {
-		size_t r = 0;
-		if (!NextFit(idx, r)) {
+	constexpr bool NextFit(int idx, int& result) const {
+		std::size_t r = 0;
+		if (idx < 0 || !NextFit(static_cast<std::size_t>(idx), r)) {
 			return false;
 		}
 		result = static_cast<int>(r);
 		return true;
 	}
 
-	bool NextFit(std::size_t idx, std::size_t& result) const {
+	constexpr bool NextFit(std::size_t idx, std::size_t& result) const {
 		if (idx < BaseOffset || idx - BaseOffset >= Bits) {
 			return false;
 		}
 		for (std::size_t i = idx; i < idx + Bits; ++i) {
 			result = (i - BaseOffset) % Bits;
-			if (fits_[result]) {
+			if (Test(result)) {
 				result += BaseOffset;
 				return true;
 			}
@@ -107,8 +123,53 @@ public:
 		return false;
 	}
 
+	// first fitting value in [idx, last value of the field], never wraps around
+	constexpr bool FirstFit(std::size_t idx, std::size_t& result) const {
+		for (std::size_t i = idx < BaseOffset ? 0 : idx - BaseOffset; i < Bits; ++i) {
+			if (Test(i)) {
+				result = i + BaseOffset;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	constexpr bool Empty() const {
+		for (std::size_t i = 0; i < kWords; ++i) {
+			if (fits_[i]) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// raw mask words, bit `i` of the field is bit `i % kWordBits` of word `i / kWordBits`
+	constexpr word_type Word(std::size_t i) const { return fits_[i]; }
+	constexpr MyTy& SetWord(std::size_t i, word_type word) {
+		fits_[i] = word;
+		return *this;
+	}
+
+	constexpr bool operator==(MyTy const& rhs) const {
+		for (std::size_t i = 0; i < kWords; ++i) {
+			if (fits_[i] != rhs.fits_[i]) {
+				return false;
+			}
+		}
+		return true;
+	}
+	constexpr bool operator!=(MyTy const& rhs) const { return !(*this == rhs); }
+
+protected:
+	constexpr void Set(std::size_t bit) {
+		fits_[bit / kWordBits] |= static_cast<word_type>(word_type(1) << (bit % kWordBits));
+	}
+	constexpr bool Test(std::size_t bit) const {
+		return (fits_[bit / kWordBits] >> (bit % kWordBits)) & 1;
+	}
+
 protected:
-	std::bitset<Bits> fits_;
+	word_type fits_[kWords];
 };
 
 // seconds, minutes in 0-59
@@ -125,59 +186,204 @@ typedef Field<7> DayOfWeekField;
 // year in 1970-2099
 typedef Field<130, 1970> YearField;
 
+constexpr bool IsLeapYear(std::size_t year) {
+	return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+// days of `month` (1-12) in `year`
+constexpr std::size_t DaysInMonth(std::size_t year, std::size_t month) {
+	return month == 2 ? (IsLeapYear(year) ? 29 : 28) : (month == 4 || month == 6 || month == 9 || month == 11) ? 30 : 31;
+}
+
+// day of week (0 is sunday) of a gregorian date
+constexpr int WeekDay(std::size_t year, std::size_t month, std::size_t day) {
+	std::size_t y = month <= 2 ? year - 1 : year;
+	std::size_t doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+	// days since 0000-03-01, which was a wednesday
+	std::size_t days = y * 365 + y / 4 - y / 100 + y / 400 + doy;
+	return static_cast<int>((days + 3) % 7);
+}
+
 
 class IRepeatable {
 public:
 	// finds next repeat timestamp in-place
 	virtual TimeUnit NextExpire(Clock const& clock) = 0;
+	// fixed interval between two firings, 0 if the config is not periodic
+	virtual TimeUnit Period() const { return 0; }
 };
 
 typedef std::shared_ptr<IRepeatable> RepeatablePtr;
 static const RepeatablePtr NullRepeatablePtr(nullptr);
 
 
-class Crontab : public IRepeatable {
+// packed masks of all crontab fields, trivially copyable and constexpr
+// constructible, cheap to store in bulk, compare and hash.
+class CronSpec {
 public:
-	Crontab() {}
-	virtual ~Crontab() {}
+	constexpr CronSpec() {}
+
+	constexpr SecondField& Second() { return second_; }
+	constexpr SecondField const& Second() const { return second_; }
+	constexpr MinuteField& Minute() { return minute_; }
+	constexpr MinuteField const& Minute() const { return minute_; }
+	constexpr HourField& Hour() { return hour_; }
+	constexpr HourField const& Hour() const { return hour_; }
+	constexpr DayOfMonthField& DayOfMonth() { return dom_; }
+	constexpr DayOfMonthField const& DayOfMonth() const { return dom_; }
+	constexpr DayOfWeekField& DayOfWeek() { return dow_; }
+	constexpr DayOfWeekField const& DayOfWeek()const { return dow_; }
+	constexpr MonthField& Month() { return month_; }
+	constexpr MonthField const& Month()const { return month_; }
+	constexpr YearField& Year() { return year_; }
+	constexpr YearField const& Year()const { return year_; }
+
+	TimeUnit NextExpire(Clock const& clock) const;
+	TimeUnit Period() const { return 0; }
+
+	// searches day by day and never past the last year of the field, returns
+	// false if there is no firing left
+	bool FindNext(std::time_t& timestamp, int offset = 1) const;
 
-	TimeUnit NextExpire(Clock const& clock) override;
-
-	SecondField& Second() { return second_; }
-	SecondField const& Second() const { return second_; }
-	MinuteField& Minute() { return minute_; }
-	MinuteField const& Minute() const { return minute_; }
-	HourField& Hour() { return hour_; }
-	HourField const& Hour() const { return hour_; }
-	DayOfMonthField& DayOfMonth() { return dom_; }
-	DayOfMonthField const& DayOfMonth() const { return dom_; }
-	DayOfWeekField& DayOfWeek() { return dow_; }
-	DayOfWeekField const& DayOfWeek()const { return dow_; }
-	MonthField& Month() { return month_; }
-	MonthField const& Month()const { return month_; }
-	YearField& Year() { return year_; }
-	YearField const& Year()const { return year_; }
+	// false if the masks can never fire: an empty field, or only month/day
+	// pairs that don't exist (Feb 30, Feb 29 without a leap year in the field)
+	constexpr bool Feasible() const {
+		if (second_.Empty() || minute_.Empty() || hour_.Empty() || dow_.Empty() || year_.Empty()) {
+			return false;
+		}
+		std::size_t lastOfFebruary = 28;
+		for (std::size_t y = 0; y < 130; ++y) {
+			if (year_.Fits(1970 + y) && IsLeapYear(1970 + y)) {
+				lastOfFebruary = 29;
+				break;
+			}
+		}
+		std::size_t day = 0;
+		if (!dom_.FirstFit(1, day)) {
+			return false;
+		}
+		for (std::size_t month = 1; month <= 12; ++month) {
+			if (month_.Fits(month) && day <= (month == 2 ? lastOfFebruary : DaysInMonth(1970, month))) {
+				return true;
+			}
+		}
+		return false;
+	}
+	constexpr void Parse(std::size_t hour, std::size_t minute, std::size_t second) {
+		year_.SetFitsAll();
+		month_.SetFitsAll();
+		dom_.SetFitsAll();
+		dow_.SetFitsAll();
+		hour_.SetSingle(hour);
+		minute_.SetSingle(minute);
+		second_.SetSingle(second);
+	}
+	constexpr void Parse(std::size_t week, std::size_t hour, std::size_t minute, std::size_t second) {
+		year_.SetFitsAll();
+		month_.SetFitsAll();
+		dom_.SetFitsAll();
+		dow_.SetSingle(week == 7 ? 0 : week);
+		hour_.SetSingle(hour);
+		minute_.SetSingle(minute);
+		second_.SetSingle(second);
+	}
+	constexpr void Parse(std::size_t month, std::size_t date, std::size_t hour, std::size_t minute, std::size_t second) {
+		year_.SetFitsAll();
+		month_.SetSingle(month);
+		dom_.SetSingle(date);
+		dow_.SetFitsAll();
+		hour_.SetSingle(hour);
+		minute_.SetSingle(minute);
+		second_.SetSingle(second);
+	}
+	constexpr void ClearAll() {
+		year_.Clear();
+		month_.Clear();
+		dom_.Clear();
+		dow_.Clear();
+		hour_.Clear();
+		minute_.Clear();
+		second_.Clear();
+	}
+	constexpr void SetAll() {
+		year_.SetFitsAll();
+		month_.SetFitsAll();
+		dom_.SetFitsAll();
+		dow_.SetFitsAll();
+		hour_.SetFitsAll();
+		minute_.SetFitsAll();
+		second_.SetFitsAll();
+	}
 
-	bool FindNext(std::time_t& timestamp, int offset = 1) const;
-	void Parse(size_t hour, size_t minute, size_t second);
-	void Parse(size_t week, size_t hour, size_t minute, size_t second);
-	void Parse(size_t month, size_t date, size_t hour, size_t minute, size_t second);
-	void ClearAll();
-	void SetAll();
+	constexpr bool operator==(CronSpec const& rhs) const {
+		return second_ == rhs.second_ && minute_ == rhs.minute_ && hour_ == rhs.hour_
+			&& dom_ == rhs.dom_ && dow_ == rhs.dow_ && month_ == rhs.month_ && year_ == rhs.year_;
+	}
+	constexpr bool operator!=(CronSpec const& rhs) const { return !(*this == rhs); }
+	std::size_t Hash() const;
 
 protected:
+	// widest fields first, no padding between the masks
+	YearField year_;
 	SecondField second_;
 	MinuteField minute_;
 	HourField hour_;
 	DayOfMonthField dom_;
-	DayOfWeekField dow_;
 	MonthField month_;
-	YearField year_;
+	DayOfWeekField dow_;
+};
+
+static_assert(std::is_trivially_copyable<CronSpec>::value, "CronSpec must stay trivially copyable");
+static_assert(sizeof(CronSpec) <= 56, "CronSpec masks are expected to stay packed");
+
+
+class Crontab : public IRepeatable, public CronSpec {
+public:
+	Crontab() {}
+	Crontab(CronSpec const& spec) : CronSpec(spec) {}
+	virtual ~Crontab() {}
+
+	TimeUnit NextExpire(Clock const& clock) override final;
+
+	CronSpec const& Spec() const { return *this; }
 };
 
 typedef std::shared_ptr<Crontab> CrontabPtr;
 
 
+// local calendar arithmetic for fixed time-of-day schedules. the utc offset
+// is cached together with the span it stays valid for, so the next hh:mm:ss
+// is plain arithmetic on local days until the offset changes (dst, or the
+// end of the scanned horizon). each Next* returns 0 when the fast path does
+// not apply and the caller should run the full crontab search instead.
+class LocalCalendar {
+public:
+	LocalCalendar() : from_(0), until_(0), offset_(0) {}
+
+	// next time strictly after `now` at local hour:minute:second
+	std::time_t NextDaily(std::time_t now, std::size_t hour, std::size_t minute, std::size_t second);
+	// same on day of week `week` (0-7, 0 and 7 are sunday)
+	std::time_t NextWeekly(std::time_t now, std::size_t week, std::size_t hour, std::size_t minute, std::size_t second);
+	// same on month (1-12) and day of month `date`
+	std::time_t NextDate(std::time_t now, std::size_t month, std::size_t date,
+		std::size_t hour, std::size_t minute, std::size_t second);
+	// forget the cached offset, e.g. after changing TZ at runtime
+	void Invalidate() { from_ = until_ = 0; }
+
+private:
+	// local seconds since epoch of `now`, refreshing the offset if needed
+	bool Local(std::time_t now, std::int64_t& local);
+	// utc time of local seconds, 0 if the cached offset does not hold there
+	std::time_t ToUtc(std::int64_t local) const;
+	bool Refresh(std::time_t now);
+
+private:
+	// the offset holds for utc times in [from_, until_)
+	std::time_t from_, until_;
+	std::int64_t offset_;
+};
+
+
 class Cycle :public IRepeatable {
 public:
 	Cycle(TimeUnit delay, int repeats, TimeUnit firstDelay=0) :
@@ -187,12 +393,69 @@ public:
 	}
 	virtual ~Cycle() {}
 
-	TimeUnit NextExpire(Clock const& clock) override;
+	TimeUnit NextExpire(Clock const& clock) override final;
+	TimeUnit Period() const override final { return delay_; }
 
 protected:
 	int repeats_;
 	TimeUnit delay_, firstDelay_;
 };
 
+
+// repeat config stored by value in the scheduler's job entry, boost::blank
+// marks a one-shot job and crontabs are kept as their packed CronSpec. Alternatives are dispatched at compile time; user
+// types only need `TimeUnit NextExpire(Clock const&)` and `TimeUnit Period() const`
+// and can be used by declaring a custom variant. Shared configs are still
+// accepted through RepeatablePtr.
+typedef boost::variant<boost::blank, Cycle, CronSpec, RepeatablePtr> RepeatConfig;
+
+class NextExpireVisitor : public boost::static_visitor<TimeUnit> {
+public:
+	explicit NextExpireVisitor(Clock const& clock) : clock_(clock) {}
+
+	TimeUnit operator()(boost::blank) const { return 0; }
+	template <class T>
+	TimeUnit operator()(std::shared_ptr<T>& repeatable) const {
+		return repeatable ? repeatable->NextExpire(clock_) : 0;
+	}
+	template <class T>
+	TimeUnit operator()(T& repeatable) const { return repeatable.NextExpire(clock_); }
+
+private:
+	Clock const& clock_;
+};
+
+class PeriodVisitor : public boost::static_visitor<TimeUnit> {
+public:
+	TimeUnit operator()(boost::blank) const { return 0; }
+	template <class T>
+	TimeUnit operator()(std::shared_ptr<T> const& repeatable) const {
+		return repeatable ? repeatable->Period() : 0;
+	}
+	template <class T>
+	TimeUnit operator()(T const& repeatable) const { return repeatable.Period(); }
+};
+
+// finds next repeat timestamp of an inline config in-place, 0 if finished
+template <class Repeat>
+inline TimeUnit NextExpire(Repeat& config, Clock const& clock) {
+	NextExpireVisitor visitor(clock);
+	return boost::apply_visitor(visitor, config);
+}
+
+template <class Repeat>
+inline TimeUnit Period(Repeat const& config) {
+	return boost::apply_visitor(PeriodVisitor(), config);
+}
+
 } // namespace crontab
-} // namespace elapse
\ No newline at end of file
+} // namespace elapse
+
+namespace std {
+
+template <>
+struct hash<elapse::crontab::CronSpec> {
+	std::size_t operator()(elapse::crontab::CronSpec const& spec) const { return spec.Hash(); }
+};
+
+} // namespace std
\ No newline at end of file
@@ -34,19 +34,33 @@ namespace elapse {
 
 class Job {
 public:
-	Job(JobId id, TimeUnit expire, ECPtr&& cb) :
+	Job(JobId id, TimeUnit expire, ECPtr&& cb, GroupTag group = NullGroup) :
 		id_(id),
 		expire_(expire),
+		group_(group),
+		batch_(nullptr),
 		cb_(std::move(cb)) {}
+	Job(JobId id, TimeUnit expire, BatchExpireCallback* batch, GroupTag group = NullGroup) :
+		id_(id),
+		expire_(expire),
+		group_(group),
+		batch_(batch) {}
 	virtual ~Job() {}
 
 	bool IsExpired(TimeUnit now) const;
 	void Fire() const;
 	bool AutoFire(TimeUnit now) const;
+	// bytes of the callback, 0 for batched jobs
+	std::size_t CallbackBytes() const { return cb_ ? cb_->Bytes() : 0; }
+	// hands the callback over to another job, this one must not fire afterwards
+	ECPtr TakeCallback() { return std::move(cb_); }
 
 public:
 	JobId id_;
 	TimeUnit expire_;
+	GroupTag group_;
+	// set for jobs collected into a batch sink instead of firing one by one
+	BatchExpireCallback* batch_;
 
 private:
 	ECPtr cb_;
@@ -27,24 +27,142 @@ OTHER DEALINGS IN THE SOFTWARE.
 
 For more information, please refer to <http://unlicense.org>
 */
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
+#include <ratio>
 #include <vector>
 #include <functional>
 #include <memory>
+#include <boost/container/pmr/memory_resource.hpp>
+#include <boost/container/pmr/global_resource.hpp>
 
 
+// scheduler time units per second, milliseconds by default. define it for the
+// whole build (library and users alike, see the cmake cache variable) to
+// 1000000 or 1000000000 for sub-millisecond deadlines
+#ifndef ELAPSE_TIME_UNITS_PER_SECOND
+#define ELAPSE_TIME_UNITS_PER_SECOND 1000
+#endif
+
 namespace elapse {
 
 typedef std::uint64_t TimeUnit;
+static const TimeUnit kTimeUnitsPerSecond = ELAPSE_TIME_UNITS_PER_SECOND;
+// one TimeUnit as a std::chrono duration
+typedef std::chrono::duration<std::int64_t, std::ratio<1, ELAPSE_TIME_UNITS_PER_SECOND>> TimeUnitDuration;
 typedef std::uint64_t JobId;
+// tag shared by a set of jobs (player, connection, tenant...), 0 for none
+typedef std::uint64_t GroupTag;
+static const GroupTag NullGroup = 0;
+
+/* tag for accessing the group index of job sets */
+struct group {};
+
+// memory resources let each scheduler allocate from its own arena
+typedef boost::container::pmr::memory_resource MemoryResource;
+
+inline MemoryResource* DefaultResource() {
+	return boost::container::pmr::get_default_resource();
+}
 
 class Job;
 typedef std::function<bool(Job const&)> JobPredicate;
 
+// approximate bytes held by a container or scheduler, estimated from element
+// and bucket counts. allocator overhead is not included
+struct MemoryUsage {
+	MemoryUsage() : nodes_(0), buckets_(0), callbacks_(0), repeats_(0), other_(0) {}
+
+	std::size_t Total() const { return nodes_ + buckets_ + callbacks_ + repeats_ + other_; }
+	MemoryUsage& operator+=(MemoryUsage const& rhs) {
+		nodes_ += rhs.nodes_;
+		buckets_ += rhs.buckets_;
+		callbacks_ += rhs.callbacks_;
+		repeats_ += rhs.repeats_;
+		other_ += rhs.other_;
+		return *this;
+	}
+
+	// a std::unordered_map: one link and the cached hash per node
+	template <class Map>
+	void AddHashMap(Map const& map) {
+		nodes_ += map.size() * (sizeof(typename Map::value_type) + 2 * sizeof(void*));
+		buckets_ += map.bucket_count() * sizeof(void*);
+	}
+	// the bucket array of a hashed multi_index index
+	template <class Index>
+	void AddHashIndex(Index const& index) {
+		buckets_ += (index.bucket_count() + 1) * sizeof(void*);
+	}
+
+	// index nodes with the entries they hold, repeat configs excluded
+	std::size_t nodes_;
+	// hash bucket arrays
+	std::size_t buckets_;
+	// callback objects owned by jobs, see ExpireCallback::Bytes
+	std::size_t callbacks_;
+	// repeat configs, inline in the entries or held by shared schedules
+	std::size_t repeats_;
+	// vector capacity: handle slots, free lists, batch buffers
+	std::size_t other_;
+};
+
+// hashed multi_index indices never give their buckets back, so a set is
+// compacted by moving its nodes into a fresh one, walking them in the order of
+// `order`. elements keep their address, iterators into the set are invalidated
+template <class Set, class Index>
+inline void CompactSet(Set& set, Index& order) {
+	Set fresh(typename Set::ctor_args_list(), set.get_allocator());
+	while (!order.empty()) {
+		fresh.insert(fresh.end(), order.extract(order.begin()));
+	}
+	set.swap(fresh);
+}
+
 class ExpireCallback {
 public:
 	virtual ~ExpireCallback() {}
 	virtual void operator()(JobId id) = 0;
+	// bytes of this callback and the callbacks it owns, for memory reports.
+	// only the base is known here, larger callbacks override it
+	virtual std::size_t Bytes() const { return sizeof(ExpireCallback); }
+
+	// callbacks keep the memory resource they come from and the size taken
+	// from it in a small header, so deleting them through ECPtr gives the
+	// memory back to the same resource. plain `new` allocates from the default
+	// resource. callback types aligned beyond max_align_t are not supported.
+	static void* operator new(std::size_t size) {
+		return operator new(size, DefaultResource());
+	}
+	static void* operator new(std::size_t size, MemoryResource* resource) {
+		auto p = static_cast<char*>(resource->allocate(size + kHeaderSize, kHeaderSize));
+		auto header = reinterpret_cast<Header*>(p);
+		header->resource_ = resource;
+		header->size_ = size + kHeaderSize;
+		return p + kHeaderSize;
+	}
+	static void operator delete(void* p, std::size_t) {
+		Deallocate(p);
+	}
+	// only called when a constructor throws
+	static void operator delete(void* p, MemoryResource*) {
+		Deallocate(p);
+	}
+
+	static const std::size_t kHeaderSize = alignof(std::max_align_t);
+
+private:
+	struct Header {
+		MemoryResource* resource_;
+		std::size_t size_;
+	};
+	static_assert(sizeof(Header) <= kHeaderSize, "callback header does not fit its alignment");
+
+	static void Deallocate(void* p) {
+		auto header = reinterpret_cast<Header*>(static_cast<char*>(p) - kHeaderSize);
+		header->resource_->deallocate(header, header->size_, kHeaderSize);
+	}
 };
 
 typedef std::unique_ptr<ExpireCallback> ECPtr;
@@ -58,6 +176,7 @@ public:
 	virtual void operator()(JobId id) override {
 		f_(id);
 	}
+	virtual std::size_t Bytes() const override { return sizeof(*this); }
 
 private:
 	Functor f_;
@@ -70,9 +189,25 @@ inline ECLambda<Functor> WrapLambda(Functor&& f) {
 
 template <class Functor>
 inline ECPtr WrapLambdaPtr(Functor&& f) {
+	static_assert(alignof(ECLambda<Functor>) <= ExpireCallback::kHeaderSize, "over-aligned callbacks are not supported");
 	return ECPtr(new ECLambda<Functor>(std::forward<Functor>(f)));
 }
 
+template <class Functor>
+inline ECPtr WrapLambdaPtr(MemoryResource* resource, Functor&& f) {
+	static_assert(alignof(ECLambda<Functor>) <= ExpireCallback::kHeaderSize, "over-aligned callbacks are not supported");
+	return ECPtr(new (resource) ECLambda<Functor>(std::forward<Functor>(f)));
+}
+
 #define ELAPSE_CB_LAMBDA_WRAPPER(varname) ECPtr(new ECLambda<Functor>(std::forward<Functor>(varname)))
 
+// receives the ids of all its jobs expired in one PopExpires with a single call,
+// after the per-job callbacks of that tick. sinks are not owned by their jobs
+// and must outlive them.
+class BatchExpireCallback {
+public:
+	virtual ~BatchExpireCallback() {}
+	virtual void operator()(JobId const* ids, size_t count) = 0;
+};
+
 } // namespace elapse
@@ -27,6 +27,7 @@ OTHER DEALINGS IN THE SOFTWARE.
 
 For more information, please refer to <http://unlicense.org>
 */
+#include <chrono>
 #include <cstdint>
 #include <vector>
 #include "JobCommons.hpp"
@@ -34,6 +35,40 @@ For more information, please refer to <http://unlicense.org>
 
 namespace elapse {
 
+// one job of a batch add, id_ is filled in by the container
+struct BatchJob {
+	BatchJob(TimeUnit expire, ECPtr&& cb, GroupTag group = NullGroup) :
+		expire_(expire),
+		cb_(std::move(cb)),
+		group_(group),
+		id_(0) {}
+
+	TimeUnit expire_;
+	ECPtr cb_;
+	GroupTag group_;
+	JobId id_;
+};
+
+// resume position of an incremental RemoveJobs, see JobContainer::RemoveJobsStep
+struct RemoveCursor {
+	enum Phase : std::uint8_t { kImmediates, kJobs, kDone };
+
+	RemoveCursor() : phase_(kImmediates), tier_(0), next_(0), expire_(0), visited_(0), removed_(0) {}
+
+	bool Done() const { return phase_ == kDone; }
+	void Reset() { *this = RemoveCursor(); }
+
+	Phase phase_;
+	// part being walked by containers made of several, see TieredJobContainer
+	std::uint8_t tier_;
+	// next job to visit and its expire time, 0 from the start of the phase
+	JobId next_;
+	TimeUnit expire_;
+	// totals since the cursor started
+	size_t visited_;
+	size_t removed_;
+};
+
 // interface
 class JobContainer {
 public:
@@ -42,8 +77,25 @@ public:
 
 	// add a handle to be called later
 	virtual JobId Add(TimeUnit expireTime, ECPtr&& cb) = 0;
+	// add a handle tagged with a group
+	virtual JobId Add(TimeUnit expireTime, ECPtr&& cb, GroupTag group) = 0;
+	// add a job fired at the start of the next PopExpires, in insertion order.
+	// immediate jobs skip the expire order, rescheduling one makes it a timed job
+	virtual JobId AddImmediate(ECPtr&& cb, GroupTag group) = 0;
+	// add a job reported through a batch sink, see BatchExpireCallback
+	virtual JobId AddBatched(TimeUnit expireTime, BatchExpireCallback* sink, GroupTag group) = 0;
+	// adds all jobs of a batch and assigns their ids, the callbacks are moved out
+	virtual void AddBatch(std::vector<BatchJob>& jobs) = 0;
+	// forgets the expired ids waiting for a flush to `sink`, for sinks going away.
+	// their pending jobs are removed by the caller
+	virtual void RemoveSink(BatchExpireCallback* sink) = 0;
 	// returns false if handle not found, otherwise true
 	virtual bool Remove(JobId handle) = 0;
+	// removes the given handles, returns the number found
+	virtual size_t RemoveBatch(std::vector<JobId> const& handles) = 0;
+	// moves a job to a new expire time in-place, returns false if handle not found.
+	// a job rescheduled after `now` from its own callback survives PopExpires.
+	virtual bool Reschedule(JobId handle, TimeUnit expireTime) = 0;
 	// cancel all callbacks
 	virtual void RemoveAll() = 0;
 	// removes all expired handles and return them, according to the given time.
@@ -52,7 +104,35 @@ public:
 	virtual void IterJobs(JobPredicate pred) const = 0;
 	// iterate handlers and remove
 	virtual void RemoveJobs(JobPredicate pred) = 0;
+	// incremental RemoveJobs, tests at most `budget` jobs and returns the number
+	// removed. the cursor resumes across calls: immediate jobs first, then the
+	// others in expire order. jobs firing or removed meanwhile are skipped, jobs
+	// added or moved behind the cursor are not visited. a job kept by `pred`
+	// may be tested again if the job the cursor stopped at is gone.
+	virtual size_t RemoveJobsStep(RemoveCursor& cursor, JobPredicate pred, size_t budget) = 0;
+	// steps of `batch` jobs until the cursor is done or `budget` elapsed
+	size_t RemoveJobsFor(RemoveCursor& cursor, JobPredicate pred, std::chrono::nanoseconds budget,
+			size_t batch = 256) {
+		auto deadline = std::chrono::steady_clock::now() + budget;
+		size_t nRemoved = 0;
+		do {
+			nRemoved += RemoveJobsStep(cursor, pred, batch);
+		} while (!cursor.Done() && std::chrono::steady_clock::now() < deadline);
+		return nRemoved;
+	}
+	// group operations, cost is linear in the size of the group.
+	// removes all jobs of a group and returns the number removed
+	virtual size_t RemoveGroup(GroupTag group) = 0;
+	virtual size_t CountGroup(GroupTag group) const = 0;
+	// iterate handlers of a group
+	virtual void IterGroup(GroupTag group, JobPredicate pred) const = 0;
 	virtual size_t Size() const = 0;
+	// expire time of the earliest job, 0 if empty and 1 if immediate jobs are pending
+	virtual TimeUnit EarliestExpire() const = 0;
+	// memory report, linear in the number of jobs
+	virtual MemoryUsage Memory() const = 0;
+	// shrinks hash buckets and buffers to the current load, e.g. after a mass cancel
+	virtual void Compact() = 0;
 };
 
 } // namespace elapse
\ No newline at end of file
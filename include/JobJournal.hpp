@@ -0,0 +1,173 @@
+#pragma once
+/*
+Author: ywx217@gmail.com
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include "JobCommons.hpp"
+
+
+namespace elapse {
+
+enum class JournalOp : std::uint8_t {
+	// an alias (re)scheduled at expire_
+	Set,
+	Erase,
+	// every alias cancelled
+	Clear,
+};
+
+// change log of the scheduled (alias, expire) pairs of a Scheduler, for one
+// reader on another thread. the scheduler thread never waits on the reader:
+// changes are buffered on its side and handed over at the end of each tick
+// with a try_lock, a busy reader only delays them to the next tick. changes
+// pile up until the reader drains them.
+template <class Key>
+class JobJournal : private boost::noncopyable {
+public:
+	struct Entry {
+		JournalOp op_;
+		Key alias_;
+		// in scheduler clock time, 0 for subscribers of a shared schedule
+		TimeUnit expire_;
+	};
+
+	JobJournal() : published_(0) {}
+
+	// --------------------------------------------------
+	// scheduler thread
+	// --------------------------------------------------
+	void Set(Key const& alias, TimeUnit expire) { pending_.push_back(Entry{JournalOp::Set, alias, expire}); }
+	void Erase(Key const& alias) { pending_.push_back(Entry{JournalOp::Erase, alias, 0}); }
+	void Clear() {
+		pending_.clear();
+		pending_.push_back(Entry{JournalOp::Clear, Key(), 0});
+	}
+	// hands the pending changes over, false if the reader holds the lock
+	bool Publish();
+	// changes logged since the last publish
+	bool Pending() const { return !pending_.empty(); }
+
+	// --------------------------------------------------
+	// reader thread
+	// --------------------------------------------------
+	// moves the published changes into `entries`, returns the number of
+	// publishes they cover. the buffers are swapped, so entries keeps its capacity
+	std::uint64_t Drain(std::vector<Entry>& entries);
+
+private:
+	std::vector<Entry> pending_;
+	std::mutex lock_;
+	std::vector<Entry> shared_;
+	std::uint64_t published_;
+};
+
+// point-in-time view of the jobs of a Scheduler, owned by the reader thread.
+// Refresh catches up with the journal, the view then matches the scheduler
+// at the end of one of its ticks and does not change until the next Refresh.
+template <class Key, class Hash=std::hash<Key>>
+class JobSnapshot : private boost::noncopyable {
+public:
+	typedef std::unordered_map<Key, TimeUnit, Hash> map_type;
+
+	explicit JobSnapshot(std::shared_ptr<JobJournal<Key>> journal) : journal_(journal), publishes_(0) {}
+
+	// applies the published changes, returns the number of changes applied
+	size_t Refresh();
+
+	map_type const& Jobs() const { return jobs_; }
+	size_t Size() const { return jobs_.size(); }
+	// expire time of an alias, 0 if it is not scheduled
+	TimeUnit Expire(Key const& alias) const {
+		auto it = jobs_.find(alias);
+		return it == jobs_.end() ? 0 : it->second;
+	}
+	// number of scheduler publishes seen so far
+	std::uint64_t Publishes() const { return publishes_; }
+
+private:
+	std::shared_ptr<JobJournal<Key>> journal_;
+	std::vector<typename JobJournal<Key>::Entry> entries_;
+	map_type jobs_;
+	std::uint64_t publishes_;
+};
+
+template <class Key>
+bool JobJournal<Key>::Publish() {
+	if (pending_.empty()) {
+		return true;
+	}
+	std::unique_lock<std::mutex> guard(lock_, std::try_to_lock);
+	if (!guard.owns_lock()) {
+		return false;
+	}
+	if (shared_.empty()) {
+		shared_.swap(pending_);
+	} else {
+		shared_.insert(shared_.end(), std::make_move_iterator(pending_.begin()),
+			std::make_move_iterator(pending_.end()));
+		pending_.clear();
+	}
+	++published_;
+	return true;
+}
+
+template <class Key>
+std::uint64_t JobJournal<Key>::Drain(std::vector<Entry>& entries) {
+	entries.clear();
+	std::lock_guard<std::mutex> guard(lock_);
+	entries.swap(shared_);
+	auto published = published_;
+	published_ = 0;
+	return published;
+}
+
+template <class Key, class Hash>
+size_t JobSnapshot<Key, Hash>::Refresh() {
+	publishes_ += journal_->Drain(entries_);
+	for (auto& entry : entries_) {
+		switch (entry.op_) {
+		case JournalOp::Set:
+			jobs_[entry.alias_] = entry.expire_;
+			break;
+		case JournalOp::Erase:
+			jobs_.erase(entry.alias_);
+			break;
+		case JournalOp::Clear:
+			jobs_.clear();
+			break;
+		}
+	}
+	return entries_.size();
+}
+
+} // namespace elapse
\ No newline at end of file
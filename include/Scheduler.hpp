@@ -27,35 +27,168 @@ OTHER DEALINGS IN THE SOFTWARE.
 
 For more information, please refer to <http://unlicense.org>
 */
+#if !defined(NDEBUG)
+#define BOOST_MULTI_INDEX_ENABLE_INVARIANT_CHECKING
+#define BOOST_MULTI_INDEX_ENABLE_SAFE_MODE
+#endif
+
+#include <algorithm>
 #include <functional>
+#include <limits>
 #include <unordered_map>
+#include <tuple>
+#include <vector>
 #include <memory>
 #include <type_traits>
 #include <boost/noncopyable.hpp>
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/member.hpp>
+#include <boost/multi_index/hashed_index.hpp>
+#include <boost/container/pmr/polymorphic_allocator.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/utility/string_view.hpp>
 #ifdef SCHEDULER_USE_POOL_ALLOCATOR
 #include <boost/pool/pool_alloc.hpp>
 #endif
 #include "JobCommons.hpp"
+#include "Job.hpp"
 #include "JobContainer.hpp"
 #include "Clock.hpp"
 #include "Crontab.hpp"
+#include "SchedulerGroup.hpp"
+#include "JobJournal.hpp"
 
 
 namespace elapse {
 
+// placement of the first firing of a periodic job inside its period, used to
+// flatten the fire load when many jobs share the same period.
+enum class PhaseSpread {
+	// keep the first delay of the repeat config
+	None,
+	// successive jobs of the same period are spread evenly over the period
+	Even,
+	// deterministic offset derived from the alias hash
+	ByAlias,
+};
+
+// hashes std::string and boost::string_view alike, so Scheduler<std::string, StringHash>
+// looks aliases up by string_view without building a temporary string
+struct StringHash {
+	size_t operator()(boost::string_view s) const { return boost::hash_range(s.begin(), s.end()); }
+};
+
+/* tag for accessing the alias index of the scheduled jobs */
+struct alias {};
+
+// bookkeeping of an aliased job inside Scheduler
+template <class Key, class Repeat>
+struct ScheduledJob {
+	ScheduledJob(Key const& alias, JobId id, GroupTag group, Repeat const& repeat) :
+		alias_(alias),
+		group_(group),
+		id_(id),
+		slot_(0),
+		repeat_(repeat) {}
+
+	Key alias_;
+	GroupTag group_;
+	// job id in the container, 0 while a repeating job is firing
+	mutable JobId id_;
+	// handle slot + 1, 0 until a handle is taken
+	mutable std::uint32_t slot_;
+	mutable Repeat repeat_;
+};
+
+// direct reference to a scheduled call, skips the alias lookup. handles go
+// stale once their call fires, is cancelled or is replaced under its alias.
+struct JobHandle {
+	JobHandle() : slot_(0), generation_(0) {}
+	JobHandle(std::uint32_t slot, std::uint32_t generation) : slot_(slot), generation_(generation) {}
+
+	bool operator==(JobHandle const& rhs) const { return slot_ == rhs.slot_ && generation_ == rhs.generation_; }
+	bool operator!=(JobHandle const& rhs) const { return !(*this == rhs); }
+
+	std::uint32_t slot_;
+	// 0 for the null handle
+	std::uint32_t generation_;
+};
+
+// one call of Scheduler::ScheduleMany
+template <class Key>
+struct ScheduleItem {
+	ScheduleItem(Key const& alias, TimeUnit expire, ECPtr&& cb, GroupTag group = NullGroup) :
+		alias_(alias),
+		expire_(expire),
+		cb_(std::move(cb)),
+		group_(group) {}
+
+	Key alias_;
+	// absolute expire time, or the delay for ScheduleManyWithDelay
+	TimeUnit expire_;
+	ECPtr cb_;
+	GroupTag group_;
+};
+
+// receives the aliases of all its jobs expired in one tick with a single call
+template <class Key>
+class BatchAliasCallback {
+public:
+	virtual ~BatchAliasCallback() {}
+	virtual void operator()(Key const* aliases, size_t count) = 0;
+};
+
+template <class SchedulerType>
+class ECBatchSchedule;
+
 // timer scheduler for more convenient uses.
-template <class Key, class Hash=std::hash<Key>>
-class Scheduler {
+// repeat configs are stored inline in the job entry as `Repeat`, a boost::variant
+// whose first alternative is boost::blank.
+// ContainerType and ClockType default to the virtual interfaces. naming `final`
+// classes instead (e.g. StaticTreeJobContainer, StaticLazyClock) lets the compiler
+// resolve and inline every container and clock call on the schedule and fire paths.
+template <class Key, class Hash=std::hash<Key>, class Repeat=crontab::RepeatConfig,
+	class ContainerType=JobContainer, class ClockType=Clock>
+class Scheduler : public SchedulerBase {
 public:
 	typedef Key key_type;
-	typedef std::pair<JobId, crontab::RepeatablePtr> value_type;
-	typedef std::unordered_map<Key, value_type, Hash> map_type;
+	typedef Repeat repeat_type;
+	typedef ContainerType container_type;
+	typedef ClockType clock_type;
+	typedef ScheduledJob<Key, Repeat> value_type;
+	typedef ScheduleItem<Key> item_type;
+	// aliases are unique, jobs of a group are reachable in O(size of the group)
+	typedef boost::multi_index_container<
+		value_type,
+		boost::multi_index::indexed_by<
+			boost::multi_index::hashed_unique<
+				boost::multi_index::tag<alias>, BOOST_MULTI_INDEX_MEMBER(value_type, Key, alias_), Hash>,
+			boost::multi_index::hashed_non_unique<
+				boost::multi_index::tag<group>, BOOST_MULTI_INDEX_MEMBER(value_type, GroupTag, group_)> >,
+		boost::container::pmr::polymorphic_allocator<value_type>
+	> map_type;
 
 public:
-	Scheduler(JobContainer* containerPtr) : clock_(new LazyClock()), container_(containerPtr), destroyFlag_(nullptr) {}
-	Scheduler(std::shared_ptr<Clock> clock, std::shared_ptr<JobContainer> containerPtr) : clock_(clock), container_(containerPtr), destroyFlag_(nullptr) {}
+	// job entries and callback wrappers are allocated from `resource`
+	Scheduler(ContainerType* containerPtr, MemoryResource* resource = DefaultResource()) :
+		clock_(new typename std::conditional<std::is_same<ClockType, Clock>::value, LazyClock, ClockType>::type()),
+		jobs_(typename map_type::ctor_args_list(), typename map_type::allocator_type(resource)),
+		container_(containerPtr),
+		destroyFlag_(nullptr),
+		resource_(resource) {}
+	Scheduler(std::shared_ptr<ClockType> clock, std::shared_ptr<ContainerType> containerPtr,
+			MemoryResource* resource = DefaultResource()) :
+		clock_(clock),
+		jobs_(typename map_type::ctor_args_list(), typename map_type::allocator_type(resource)),
+		container_(containerPtr),
+		destroyFlag_(nullptr),
+		resource_(resource) {}
 	virtual ~Scheduler() {
 		CancelAll();
+		// a shared container may still hold expired ids for our sinks
+		for (auto const& it : batchSinks_) {
+			container_->RemoveSink(it.second.get());
+		}
 		if (destroyFlag_) {
 			*destroyFlag_ = true;
 			destroyFlag_ = nullptr;
@@ -64,263 +197,1243 @@ public:
 
 	// member variable accessing
 	map_type const& Jobs() const { return jobs_; }
-	JobContainer const& Container() const { return *container_; }
-	std::shared_ptr<JobContainer> const& ContainerPtr() const { return container_; }
+	ContainerType const& Container() const { return *container_; }
+	std::shared_ptr<ContainerType> const& ContainerPtr() const { return container_; }
+	std::shared_ptr<ClockType> const& ClockPtr() const { return clock_; }
+	MemoryResource* Resource() const { return resource_; }
+
+	// memory of the alias entries, handles and shared schedules plus the
+	// container's, linear in the number of jobs
+	MemoryUsage Memory() const;
+	// shrinks the alias map, the bookkeeping maps and the container to the
+	// current load. handle slots are kept, their generations guard stale handles
+	void Compact();
+	// logs every change of the scheduled aliases to `journal`, published at the
+	// end of each tick for a JobSnapshot on another thread. the current jobs are
+	// logged first, null detaches. while changes are unpublished NextDeadline
+	// is now, so idle schedulers in a group or a driver still publish them
+	void SetJournal(std::shared_ptr<JobJournal<Key>> journal);
+	std::shared_ptr<JobJournal<Key>> const& Journal() const { return journal_; }
 
 	// clock manipulation
 	void Advance(TimeOffset delta);
 	// bookkeeping all scheduled jobs
-	void Tick();
+	virtual void Tick() override;
+	virtual TimeUnit NextDeadline() const override;
 
 	// schedule a new call with delay
-	void Schedule(Key const& alias, TimeUnit expireTime, ECPtr&& cb);
+	void Schedule(Key const& alias, TimeUnit expireTime, ECPtr&& cb, GroupTag group = NullGroup);
 	// schedule a new repeated callback
-	void ScheduleRepeat(Key const& alias, crontab::RepeatablePtr const& repeatConfig, ECPtr&& cb);
+	void ScheduleRepeat(Key const& alias, Repeat const& repeatConfig, ECPtr&& cb,
+		PhaseSpread spread = PhaseSpread::None, GroupTag group = NullGroup);
+	// schedule a call reported through a batch sink together with the other
+	// jobs of that sink expiring in the same tick, the sink must outlive its jobs
+	void ScheduleBatched(Key const& alias, TimeUnit expireTime, BatchAliasCallback<Key>* sink,
+		GroupTag group = NullGroup);
+	// cancel the pending calls of a batch sink and forget the sink, returns the
+	// number of calls cancelled. the sink may remove itself from its own call
+	size_t RemoveSink(BatchAliasCallback<Key>* sink);
 	// cancel a call
-	bool Cancel(Key const& alias);
+	bool Cancel(Key const& alias) { return CancelJob(jobs_.find(alias)); }
 	void CancelAll();
+	// move a pending call to a new expire time, false if it is not pending
+	bool Reschedule(Key const& alias, TimeUnit expireTime);
 	// check has a callback
-	bool HasCallback(Key const& alias) const;
+	bool HasCallback(Key const& alias) const { return jobs_.find(alias) != jobs_.end(); }
+
+	// heterogeneous lookup, e.g. boost::string_view aliases with StringHash.
+	// the key must hash and compare equal like the stored alias it matches
+	template <class CompatibleKey>
+	bool Cancel(CompatibleKey const& alias) { return CancelJob(FindAlias(alias)); }
+	template <class CompatibleKey>
+	bool Reschedule(CompatibleKey const& alias, TimeUnit expireTime);
+	template <class CompatibleKey>
+	bool HasCallback(CompatibleKey const& alias) const { return FindAlias(alias) != jobs_.end(); }
+	template <class CompatibleKey>
+	JobHandle Handle(CompatibleKey const& alias);
+
+	// --------------------------------------------------
+	// handle operations, no alias hashing
+	// --------------------------------------------------
+	// same as Schedule, returning a handle to the call
+	JobHandle ScheduleHandle(Key const& alias, TimeUnit expireTime, ECPtr&& cb, GroupTag group = NullGroup);
+	// handle of any scheduled call, null if the alias is not scheduled
+	JobHandle Handle(Key const& alias) { return Handle<Key>(alias); }
+	bool IsValid(JobHandle handle) const { return Resolve(handle) != nullptr; }
+	bool Cancel(JobHandle handle);
+	bool Reschedule(JobHandle handle, TimeUnit expireTime);
+
+	// --------------------------------------------------
+	// batch operations, the clock is read once per batch
+	// --------------------------------------------------
+	// schedule many calls, a later item replaces an earlier one of the same alias
+	void ScheduleMany(std::vector<item_type>&& items);
+	void ScheduleManyWithDelay(std::vector<item_type>&& items);
+	// cancel many calls, returns the number cancelled
+	size_t CancelMany(std::vector<Key> const& aliases);
+
+	// --------------------------------------------------
+	// group operations, linear in the size of the group
+	// --------------------------------------------------
+	// cancel all calls of a group, returns the number cancelled
+	size_t CancelGroup(GroupTag group);
+	size_t CountGroup(GroupTag group) const;
+	// iterate aliases of a group until pred(alias) returns false
+	template <class Predicate>
+	void IterGroup(GroupTag group, Predicate&& pred) const;
 
 	// --------------------------------------------------
 	// enhanced schedule methods
 	// --------------------------------------------------
-	void ScheduleWithDelay(Key const& alias, TimeUnit delayInMillis, ECPtr&& cb);
-	void ScheduleAt(Key const& alias, size_t hour, size_t minute, size_t second, ECPtr&& cb);
+	// run at the start of the next tick, in scheduling order
+	void ScheduleNextTick(Key const& alias, ECPtr&& cb, GroupTag group = NullGroup);
+	// a delay (in time units) of 0 runs the call next tick
+	void ScheduleWithDelay(Key const& alias, TimeUnit delay, ECPtr&& cb, GroupTag group = NullGroup);
+	// next local hour:minute:second, arithmetic on a cached utc offset
+	void ScheduleAt(Key const& alias, size_t hour, size_t minute, size_t second, ECPtr&& cb,
+		GroupTag group = NullGroup);
+	// same on the next day of week `week` (0-7, 0 and 7 are sunday)
+	void ScheduleWeeklyAt(Key const& alias, size_t week, size_t hour, size_t minute, size_t second, ECPtr&& cb,
+		GroupTag group = NullGroup);
+	// same on the next month (1-12) and day of month `date`
+	void ScheduleAtDate(Key const& alias, size_t month, size_t date, size_t hour, size_t minute, size_t second,
+		ECPtr&& cb, GroupTag group = NullGroup);
+	// the ScheduleAt family caches the utc offset until the next dst switch,
+	// call after changing TZ at runtime. scheduled calls keep their time
+	void InvalidateCalendar() { calendar_.Invalidate(); }
+
+	// --------------------------------------------------
+	// shared schedules, one container job for many aliases
+	// --------------------------------------------------
+	// subscribe `alias` to the repeat schedule named `schedule`. the first
+	// subscriber creates the schedule from `repeatConfig`, later ones join it
+	// as is. the config is evaluated once per firing and a single container job
+	// calls every subscriber. a cancelled or replaced subscriber releases its
+	// callback at once, the schedule and its job go with the last subscriber.
+	void ScheduleShared(Key const& alias, Key const& schedule, Repeat const& repeatConfig, ECPtr&& cb,
+		GroupTag group = NullGroup);
+	bool HasSharedSchedule(Key const& schedule) const { return sharedSchedules_.count(schedule) != 0; }
 
 	// --------------------------------------------------
 	// lambda wrapper
 	// --------------------------------------------------
 	// schedule a new call with delay
 	template <class Functor>
-	void ScheduleLambda(Key const& alias, TimeUnit expireTime, Functor&& cb);
+	void ScheduleLambda(Key const& alias, TimeUnit expireTime, Functor&& cb, GroupTag group = NullGroup);
 	// schedule a new repeated callback
 	template <class Functor>
-	void ScheduleRepeatLambda(Key const& alias, crontab::RepeatablePtr const& repeatConfig, Functor&& cb);
+	void ScheduleRepeatLambda(Key const& alias, Repeat const& repeatConfig, Functor&& cb,
+		PhaseSpread spread = PhaseSpread::None, GroupTag group = NullGroup);
+	template <class Functor>
+	void ScheduleSharedLambda(Key const& alias, Key const& schedule, Repeat const& repeatConfig, Functor&& cb,
+		GroupTag group = NullGroup);
 	template <class Functor>
-	void ScheduleWithDelayLambda(Key const& alias, TimeUnit delayInMillis, Functor&& cb);
+	void ScheduleWithDelayLambda(Key const& alias, TimeUnit delay, Functor&& cb, GroupTag group = NullGroup);
 	template <class Functor>
-	void ScheduleAtLambda(Key const& alias, size_t hour, size_t minute, size_t second, Functor&& cb);
+	void ScheduleAtLambda(Key const& alias, size_t hour, size_t minute, size_t second, Functor&& cb,
+		GroupTag group = NullGroup);
+	template <class Functor>
+	void ScheduleWeeklyAtLambda(Key const& alias, size_t week, size_t hour, size_t minute, size_t second, Functor&& cb,
+		GroupTag group = NullGroup);
+	template <class Functor>
+	void ScheduleAtDateLambda(Key const& alias, size_t month, size_t date, size_t hour, size_t minute, size_t second,
+		Functor&& cb, GroupTag group = NullGroup);
 
 protected:
-	// replace a call (more effecient than cancel & add)
-	bool ReplaceJob(Key const& alias, TimeUnit expireTime, crontab::RepeatablePtr const& repeatConfig, ECPtr&& wrappedCallback);
-	// callback triggered, remove from alias map
-	bool OnTriggered(Key const& alias, JobId id);
+	struct SharedSubscriber {
+		JobHandle handle_;
+		ECPtr cb_;
+	};
+	struct SharedSchedule {
+		SharedSchedule(Key const& name, Repeat const& repeat) :
+			name_(name),
+			repeat_(repeat),
+			id_(0),
+			live_(0),
+			firing_(false) {}
+
+		Key name_;
+		Repeat repeat_;
+		JobId id_;
+		// subscribers still holding a callback, cancelled ones leave a null entry
+		size_t live_;
+		bool firing_;
+		std::vector<SharedSubscriber> subscribers_;
+	};
+	struct Subscription {
+		SharedSchedule* shared_;
+		// position in SharedSchedule::subscribers_
+		size_t index_;
+	};
 
-	template <class K, class H>
+	// schedule a one-shot call, handles are only taken when asked for
+	typename map_type::iterator ScheduleOnce(Key const& alias, TimeUnit expireTime, ECPtr&& cb, GroupTag group);
+	// replace a call (more effecient than cancel & add), returns the alias entry
+	typename map_type::iterator ReplaceJob(Key const& alias, TimeUnit expireTime, Repeat&& repeatConfig, ECPtr&& wrappedCallback,
+		GroupTag group);
+	// maps an alias to a container job expiring at `expireTime` (for the
+	// journal), returns the job id it replaced or 0
+	JobId BindJob(Key const& alias, JobId id, TimeUnit expireTime, GroupTag group, Repeat&& repeatConfig,
+		typename map_type::iterator* bound = nullptr);
+	// journal to log a change to, null if none. a grouped scheduler only ticks
+	// when due, so the first change after a publish asks its group for a tick
+	JobJournal<Key>* Journaling();
+	// erase an alias entry, invalidating its handle
+	void EraseJob(typename map_type::iterator it);
+	bool CancelJob(typename map_type::iterator it);
+	template <class CompatibleKey>
+	typename map_type::iterator FindAlias(CompatibleKey const& alias);
+	template <class CompatibleKey>
+	typename map_type::const_iterator FindAlias(CompatibleKey const& alias) const;
+	// handle slots
+	JobHandle MakeHandle(value_type const& job);
+	void ReleaseSlot(value_type const& job);
+	value_type const* Resolve(JobHandle handle) const;
+	bool RescheduleJob(value_type const& job, TimeUnit expireTime);
+	void ScheduleBatch(std::vector<item_type>&& items, bool withDelay);
+	// removes jobs from the container and forgets their batched aliases
+	void RemoveJob(JobId id);
+	void RemoveJobs(std::vector<JobId> const& ids);
+	// re-arm a fired repeating job in-place, returns false if the repeat is finished
+	bool RearmJob(typename map_type::iterator it, JobId id);
+	// one-shot callback triggered, remove from alias map
+	bool OnTriggered(value_type const* job, JobId id);
+	// calls the subscribers of a shared schedule and re-arms it once
+	void FireShared(SharedSchedule& shared, JobId id);
+	// releases the callback of the subscriber entry in handle slot `slot`,
+	// removing its schedule when it was the last subscriber
+	void Unsubscribe(std::uint32_t slot);
+	// drops the null entries of a schedule not firing
+	void CompactSubscribers(SharedSchedule& shared);
+	// schedules at the fast path time `next`, or else at the next firing of `cron`
+	void ScheduleAtTime(Key const& alias, std::time_t next, crontab::CronSpec const& cron, ECPtr&& cb, GroupTag group);
+	// offset of the first firing in [1, period]
+	TimeUnit SpreadPhase(Key const& alias, TimeUnit period, PhaseSpread spread);
+	// allocate a callback wrapper from the memory resource
+	template <class Callback>
+	Callback* NewCallback(ECPtr&& cb);
+
+	template <class S>
 	friend class ECOneTimeSchedule;
-	template <class K, class H>
+	template <class S>
 	friend class ECRepeatSchedule;
+	template <class S>
+	friend class ECBatchSchedule;
+	template <class S>
+	friend class ECSharedSchedule;
 
 protected:
-	std::shared_ptr<Clock> clock_;
+	std::shared_ptr<ClockType> clock_;
 	map_type jobs_;
-	std::shared_ptr<JobContainer> container_;
+	std::shared_ptr<ContainerType> container_;
 	bool *destroyFlag_;
+	// number of evenly spread jobs handed out per period
+	std::unordered_map<TimeUnit, std::uint64_t> spreadCounters_;
+	MemoryResource* resource_;
+	// pending batched jobs, and one container sink per user sink
+	struct BatchedJob {
+		JobHandle handle_;
+		BatchAliasCallback<Key>* sink_;
+	};
+	std::unordered_map<JobId, BatchedJob> batchJobs_;
+	std::unordered_map<BatchAliasCallback<Key>*, std::unique_ptr<ECBatchSchedule<Scheduler>>> batchSinks_;
+	// shared schedules by name, subscribers are alias entries with no job of their own
+	std::unordered_map<Key, std::unique_ptr<SharedSchedule>, Hash> sharedSchedules_;
+	// subscription of each subscriber entry by its handle slot, dropped when the slot is released
+	std::unordered_map<std::uint32_t, Subscription> subscriptions_;
+	// handle slots, a slot is reused with a bumped generation once released
+	struct HandleSlot {
+		value_type const* job_;
+		std::uint32_t generation_;
+	};
+	std::vector<HandleSlot> slots_;
+	std::vector<std::uint32_t> freeSlots_;
+	// utc offset cache of the ScheduleAt family
+	crontab::LocalCalendar calendar_;
+	std::shared_ptr<JobJournal<Key>> journal_;
 };
 
-template <class Key, class Hash>
+// scheduler bound to a concrete container and clock, all calls on them are direct
+template <class Key, class ContainerType, class ClockType=StaticLazyClock, class Hash=std::hash<Key>,
+	class Repeat=crontab::RepeatConfig>
+using StaticScheduler = Scheduler<Key, Hash, Repeat, ContainerType, ClockType>;
+
+template <class SchedulerType>
 class ECOneTimeSchedule : public ExpireCallback, private boost::noncopyable {
 public:
-	ECOneTimeSchedule(Scheduler<Key, Hash> *scheduler, Key const& alias, ECPtr&& cb) :
+	typedef typename SchedulerType::value_type value_type;
+
+	ECOneTimeSchedule(SchedulerType *scheduler, ECPtr&& cb) :
 		scheduler_(scheduler),
-		alias_(alias),
+		job_(nullptr),
 		cb_(std::move(cb)) {}
 	virtual ~ECOneTimeSchedule() {}
 
+	// the alias entry is reached by address, the key is stored once. an entry
+	// bound to a one-shot job is only erased after that job is removed, or
+	// by the job itself when it fires, so the address stays valid until then
+	void Bind(value_type const* job) { job_ = job; }
+
 	virtual void operator()(JobId id) override {
-		scheduler_->OnTriggered(alias_, id);
+		scheduler_->OnTriggered(job_, id);
 		(*cb_)(id);
 	}
+	virtual std::size_t Bytes() const override { return sizeof(*this) + cb_->Bytes(); }
 
 #ifdef SCHEDULER_USE_POOL_ALLOCATOR
 public:
 	void* operator new(size_t) { return pool_.allocate(); }
-	void operator delete(void *p) { pool_.deallocate(static_cast<ECOneTimeSchedule<Key, Hash>*>(p)); }
+	void operator delete(void *p) { pool_.deallocate(static_cast<ECOneTimeSchedule<SchedulerType>*>(p)); }
 
 private:
 	void* operator new[](size_t);
 	void operator delete[](void*);
 
-	static boost::fast_pool_allocator<ECOneTimeSchedule<Key, Hash>> pool_;
+	static boost::fast_pool_allocator<ECOneTimeSchedule<SchedulerType>> pool_;
 #endif
 
 private:
-	Scheduler<Key, Hash> *scheduler_;
-	Key alias_;
+	SchedulerType *scheduler_;
+	value_type const* job_;
 	ECPtr cb_;
 };
 
-template <class Key, class Hash>
+template <class SchedulerType>
 class ECRepeatSchedule : public ExpireCallback, private boost::noncopyable {
 public:
-	ECRepeatSchedule(Scheduler<Key, Hash> *scheduler, Key const& alias, ECPtr&& cb) :
+	ECRepeatSchedule(SchedulerType *scheduler, ECPtr&& cb) :
 		scheduler_(scheduler),
-		alias_(alias),
 		cb_(std::move(cb)) {}
 	virtual ~ECRepeatSchedule() {
 		scheduler_ = nullptr;
 	}
 
+	void Bind(JobHandle handle) { handle_ = handle; }
+
 	virtual void operator()(JobId id) override {
 		// TODO: test reschedule in the callback
 		if (!scheduler_) {
 			return;
 		}
-		auto it = scheduler_->jobs_.find(alias_);
-		if (it == scheduler_->jobs_.end()) {
+		auto job = scheduler_->Resolve(handle_);
+		if (!job) {
 			return;
 		}
 		bool destroyFlag = false;
-		it->second.first = 0;
+		job->id_ = 0;
 		scheduler_->destroyFlag_ = &destroyFlag;
 		(*cb_)(id);
 		if (destroyFlag) {
 			return;
 		}
 		scheduler_->destroyFlag_ = nullptr;
-		it = scheduler_->jobs_.find(alias_);
-		if (it == scheduler_->jobs_.end() || it->second.first != 0 || !it->second.second) {
+		// cancelled or replaced by the callback
+		job = scheduler_->Resolve(handle_);
+		if (!job || job->id_ != 0) {
 			return;
 		}
-		scheduler_->ScheduleRepeat(alias_, it->second.second, std::move(cb_));
+		scheduler_->RearmJob(scheduler_->jobs_.iterator_to(*job), id);
 	}
+	virtual std::size_t Bytes() const override { return sizeof(*this) + cb_->Bytes(); }
 
 #ifdef SCHEDULER_USE_POOL_ALLOCATOR
 public:
 	void* operator new(size_t) { return pool_.allocate(); }
-	void operator delete(void *p) { pool_.deallocate(static_cast<ECRepeatSchedule<Key, Hash>*>(p)); }
+	void operator delete(void *p) { pool_.deallocate(static_cast<ECRepeatSchedule<SchedulerType>*>(p)); }
 
 private:
 	void* operator new[](size_t);
 	void operator delete[](void*);
 
-	static boost::fast_pool_allocator<ECRepeatSchedule<Key, Hash>> pool_;
+	static boost::fast_pool_allocator<ECRepeatSchedule<SchedulerType>> pool_;
 #endif
 
 private:
-	Scheduler<Key, Hash> *scheduler_;
-	Key alias_;
+	SchedulerType *scheduler_;
+	JobHandle handle_;
 	ECPtr cb_;
 };
 
-template <class Key, class Hash>
-void Scheduler<Key, Hash>::Advance(TimeOffset delta) {
+// forwards the expired job ids of one user sink as aliases
+template <class SchedulerType>
+class ECBatchSchedule : public BatchExpireCallback, private boost::noncopyable {
+public:
+	typedef typename SchedulerType::key_type Key;
+
+	ECBatchSchedule(SchedulerType *scheduler, BatchAliasCallback<Key> *sink) :
+		scheduler_(scheduler),
+		sink_(sink),
+		removeFlag_(nullptr) {}
+	virtual ~ECBatchSchedule() {
+		if (removeFlag_) {
+			*removeFlag_ = true;
+		}
+	}
+
+	virtual void operator()(JobId const* ids, size_t count) override {
+		std::vector<Key> aliases;
+		aliases.swap(aliases_);
+		for (size_t i = 0; i < count; ++i) {
+			auto found = scheduler_->batchJobs_.find(ids[i]);
+			if (found == scheduler_->batchJobs_.end()) {
+				continue;
+			}
+			auto job = scheduler_->Resolve(found->second.handle_);
+			scheduler_->batchJobs_.erase(found);
+			if (job) {
+				aliases.push_back(job->alias_);
+				scheduler_->EraseJob(scheduler_->jobs_.iterator_to(*job));
+			}
+		}
+		if (aliases.empty()) {
+			aliases_.swap(aliases);
+			return;
+		}
+		bool destroyFlag = false, removeFlag = false;
+		auto scheduler = scheduler_;
+		scheduler->destroyFlag_ = &destroyFlag;
+		removeFlag_ = &removeFlag;
+		(*sink_)(aliases.data(), aliases.size());
+		if (destroyFlag) {
+			return;
+		}
+		scheduler->destroyFlag_ = nullptr;
+		// the sink removed itself, this adapter is gone
+		if (removeFlag) {
+			return;
+		}
+		removeFlag_ = nullptr;
+		aliases.clear();
+		aliases_.swap(aliases);
+	}
+
+private:
+	SchedulerType *scheduler_;
+	BatchAliasCallback<Key> *sink_;
+	bool *removeFlag_;
+	// reused across ticks
+	std::vector<Key> aliases_;
+};
+
+// the container job of a shared schedule
+template <class SchedulerType>
+class ECSharedSchedule : public ExpireCallback, private boost::noncopyable {
+public:
+	typedef typename SchedulerType::SharedSchedule SharedSchedule;
+
+	ECSharedSchedule(SchedulerType *scheduler, SharedSchedule *shared) :
+		scheduler_(scheduler),
+		shared_(shared) {}
+	virtual ~ECSharedSchedule() {}
+
+	virtual void operator()(JobId id) override {
+		scheduler_->FireShared(*shared_, id);
+	}
+	// the subscribers are reported by the scheduler
+	virtual std::size_t Bytes() const override { return sizeof(*this); }
+
+private:
+	SchedulerType *scheduler_;
+	SharedSchedule *shared_;
+};
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::Advance(TimeOffset delta) {
 	clock_->Advance(delta);
 }
 
-template <class Key, class Hash>
-void Scheduler<Key, Hash>::Tick() {
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::Tick() {
 	auto now = clock_->Now();
+	// the journal may go away with a scheduler destroyed by its callbacks
+	auto journal = journal_;
 	container_->PopExpires(now);
+	if (journal) {
+		journal->Publish();
+	}
 }
 
-template <class Key, class Hash>
-void Scheduler<Key, Hash>::Schedule(Key const& alias, TimeUnit expireTime, ECPtr&& cb) {
-	ReplaceJob(alias, expireTime, crontab::NullRepeatablePtr, ECPtr(new ECOneTimeSchedule<Key, Hash>(this, alias, std::move(cb))));
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+TimeUnit Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::NextDeadline() const {
+	auto expireTime = container_->EarliestExpire();
+	auto deadline = expireTime ? clock_->ToBaseTime(expireTime) : 0;
+	// changes not handed over yet are published by the next tick
+	if (journal_ && journal_->Pending()) {
+		auto now = clock_->ToBaseTime(clock_->Now());
+		deadline = deadline ? std::min(deadline, now) : now;
+	}
+	return deadline;
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::Schedule(Key const& alias, TimeUnit expireTime, ECPtr&& cb, GroupTag group) {
+	ScheduleOnce(alias, expireTime, std::move(cb), group);
 }
 
-template <class Key, class Hash>
-void Scheduler<Key, Hash>::ScheduleRepeat(
-			Key const& alias, crontab::RepeatablePtr const& repeatConfig, ECPtr&& cb) {
-	auto expireTime = repeatConfig->NextExpire(*clock_);
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::ScheduleRepeat(
+			Key const& alias, Repeat const& repeatConfig, ECPtr&& cb, PhaseSpread spread, GroupTag group) {
+	Repeat config(repeatConfig);
+	auto expireTime = crontab::NextExpire(config, *clock_);
 	if (!expireTime) {
 		Cancel(alias);
 		return;
 	}
-	ReplaceJob(alias, expireTime, repeatConfig, ECPtr(new ECRepeatSchedule<Key, Hash>(this, alias, std::move(cb))));
+	auto period = crontab::Period(config);
+	if (spread != PhaseSpread::None && period > 0) {
+		expireTime = clock_->Now() + SpreadPhase(alias, period, spread);
+	}
+	auto callback = NewCallback<ECRepeatSchedule<Scheduler>>(std::move(cb));
+	auto it = ReplaceJob(alias, expireTime, std::move(config), ECPtr(callback), group);
+	callback->Bind(MakeHandle(*it));
 }
 
-template <class Key, class Hash>
-bool Scheduler<Key, Hash>::Cancel(Key const& alias) {
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::ScheduleBatched(
+			Key const& alias, TimeUnit expireTime, BatchAliasCallback<Key>* sink, GroupTag group) {
+	auto& adapter = batchSinks_[sink];
+	if (!adapter) {
+		adapter.reset(new ECBatchSchedule<Scheduler>(this, sink));
+	}
+	expireTime = std::max(expireTime, clock_->Now() + 1);
+	auto id = container_->AddBatched(expireTime, adapter.get(), group);
+	if (Group()) {
+		OnScheduled(clock_->ToBaseTime(expireTime));
+	}
+	typename map_type::iterator it;
+	auto replaced = BindJob(alias, id, expireTime, group, Repeat(), &it);
+	batchJobs_.emplace(id, BatchedJob{MakeHandle(*it), sink});
+	if (replaced) {
+		RemoveJob(replaced);
+	}
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+size_t Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::RemoveSink(BatchAliasCallback<Key>* sink) {
+	auto adapter = batchSinks_.find(sink);
+	if (adapter == batchSinks_.end()) {
+		return 0;
+	}
+	std::vector<JobId> ids;
+	for (auto it = batchJobs_.begin(); it != batchJobs_.end();) {
+		if (it->second.sink_ != sink) {
+			++it;
+			continue;
+		}
+		if (auto job = Resolve(it->second.handle_)) {
+			EraseJob(jobs_.iterator_to(*job));
+		}
+		ids.push_back(it->first);
+		it = batchJobs_.erase(it);
+	}
+	container_->RemoveBatch(ids);
+	container_->RemoveSink(adapter->second.get());
+	batchSinks_.erase(adapter);
+	return ids.size();
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::ScheduleShared(
+			Key const& alias, Key const& schedule, Repeat const& repeatConfig, ECPtr&& cb, GroupTag group) {
+	// the replaced call goes first, it may be the last subscriber of this very schedule
+	typename map_type::iterator it;
+	auto replaced = BindJob(alias, 0, 0, group, Repeat(), &it);
+	if (replaced) {
+		RemoveJob(replaced);
+	}
+	auto& shared = sharedSchedules_[schedule];
+	if (!shared) {
+		shared.reset(new SharedSchedule(schedule, repeatConfig));
+		auto expireTime = crontab::NextExpire(shared->repeat_, *clock_);
+		if (!expireTime) {
+			sharedSchedules_.erase(schedule);
+			EraseJob(it);
+			return;
+		}
+		expireTime = std::max(expireTime, clock_->Now() + 1);
+		auto callback = new (resource_) ECSharedSchedule<Scheduler>(this, shared.get());
+		shared->id_ = container_->Add(expireTime, ECPtr(callback));
+		if (Group()) {
+			OnScheduled(clock_->ToBaseTime(expireTime));
+		}
+	}
+	auto handle = MakeHandle(*it);
+	subscriptions_[handle.slot_] = Subscription{shared.get(), shared->subscribers_.size()};
+	shared->subscribers_.push_back(SharedSubscriber{handle, std::move(cb)});
+	++shared->live_;
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+bool Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::Reschedule(Key const& alias, TimeUnit expireTime) {
 	auto it = jobs_.find(alias);
-	if (it == jobs_.end()) {
+	return it != jobs_.end() && RescheduleJob(*it, expireTime);
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+template <class CompatibleKey>
+bool Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::Reschedule(CompatibleKey const& alias, TimeUnit expireTime) {
+	auto it = FindAlias(alias);
+	return it != jobs_.end() && RescheduleJob(*it, expireTime);
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+JobHandle Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::ScheduleHandle(
+			Key const& alias, TimeUnit expireTime, ECPtr&& cb, GroupTag group) {
+	return MakeHandle(*ScheduleOnce(alias, expireTime, std::move(cb), group));
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+typename Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::map_type::iterator Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::ScheduleOnce(
+			Key const& alias, TimeUnit expireTime, ECPtr&& cb, GroupTag group) {
+	auto callback = NewCallback<ECOneTimeSchedule<Scheduler>>(std::move(cb));
+	auto it = ReplaceJob(alias, expireTime, Repeat(), ECPtr(callback), group);
+	callback->Bind(&*it);
+	return it;
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+template <class CompatibleKey>
+JobHandle Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::Handle(CompatibleKey const& alias) {
+	auto it = FindAlias(alias);
+	return it == jobs_.end() ? JobHandle() : MakeHandle(*it);
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+bool Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::Cancel(JobHandle handle) {
+	auto job = Resolve(handle);
+	if (!job) {
 		return false;
 	}
-	container_->Remove(it->second.first);
-	jobs_.erase(it);
+	// shared subscribers and firing repeat jobs have no job of their own (id 0)
+	if (job->id_) {
+		RemoveJob(job->id_);
+	}
+	EraseJob(jobs_.iterator_to(*job));
 	return true;
 }
 
-template <class Key, class Hash>
-void Scheduler<Key, Hash>::CancelAll() {
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+bool Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::Reschedule(JobHandle handle, TimeUnit expireTime) {
+	auto job = Resolve(handle);
+	return job && RescheduleJob(*job, expireTime);
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::ScheduleMany(std::vector<item_type>&& items) {
+	ScheduleBatch(std::move(items), false);
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::ScheduleManyWithDelay(std::vector<item_type>&& items) {
+	ScheduleBatch(std::move(items), true);
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+size_t Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::CancelMany(std::vector<Key> const& aliases) {
+	std::vector<JobId> ids;
+	ids.reserve(aliases.size());
+	size_t nCancelled = 0;
+	for (auto const& alias : aliases) {
+		auto it = jobs_.find(alias);
+		if (it == jobs_.end()) {
+			continue;
+		}
+		// a firing repeat job (id 0) is dropped by its container after the callback
+		if (it->id_) {
+			ids.push_back(it->id_);
+		}
+		EraseJob(it);
+		++nCancelled;
+	}
+	RemoveJobs(ids);
+	return nCancelled;
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::CancelAll() {
+	// the shared schedules are dropped as a whole below
+	subscriptions_.clear();
 	for (auto const& it : jobs_) {
-		container_->Remove(it.second.first);
+		if (it.id_) {
+			container_->Remove(it.id_);
+		}
+		ReleaseSlot(it);
 	}
 	jobs_.clear();
+	batchJobs_.clear();
+	if (auto journal = Journaling()) {
+		journal->Clear();
+	}
+	for (auto it = sharedSchedules_.begin(); it != sharedSchedules_.end();) {
+		// a firing schedule is dropped by FireShared once its subscribers are gone
+		if (it->second->firing_) {
+			it->second->subscribers_.clear();
+			it->second->live_ = 0;
+			++it;
+			continue;
+		}
+		container_->Remove(it->second->id_);
+		it = sharedSchedules_.erase(it);
+	}
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+MemoryUsage Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::Memory() const {
+	MemoryUsage usage = container_->Memory();
+	// two hashed indices per alias entry, its repeat config is reported apart
+	usage.nodes_ += jobs_.size() * (sizeof(value_type) - sizeof(Repeat) + 4 * sizeof(void*));
+	usage.repeats_ += jobs_.size() * sizeof(Repeat);
+	usage.AddHashIndex(boost::multi_index::get<alias>(jobs_));
+	usage.AddHashIndex(boost::multi_index::get<elapse::group>(jobs_));
+	usage.AddHashMap(spreadCounters_);
+	usage.AddHashMap(batchJobs_);
+	usage.AddHashMap(batchSinks_);
+	usage.other_ += batchSinks_.size() * sizeof(ECBatchSchedule<Scheduler>);
+	usage.AddHashMap(sharedSchedules_);
+	usage.AddHashMap(subscriptions_);
+	for (auto const& it : sharedSchedules_) {
+		usage.repeats_ += sizeof(SharedSchedule);
+		usage.other_ += it.second->subscribers_.capacity() * sizeof(SharedSubscriber);
+		for (auto const& subscriber : it.second->subscribers_) {
+			usage.callbacks_ += subscriber.cb_ ? subscriber.cb_->Bytes() : 0;
+		}
+	}
+	usage.other_ += slots_.capacity() * sizeof(HandleSlot) + freeSlots_.capacity() * sizeof(std::uint32_t);
+	return usage;
 }
 
-template <class Key, class Hash>
-bool Scheduler<Key, Hash>::HasCallback(Key const& alias) const {
-	return jobs_.find(alias) != jobs_.end();
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::Compact() {
+	// entries keep their address, handle slots stay valid
+	if (jobs_.bucket_count() > 2 * jobs_.size() + 64) {
+		CompactSet(jobs_, jobs_);
+	}
+	batchJobs_.rehash(0);
+	batchSinks_.rehash(0);
+	sharedSchedules_.rehash(0);
+	subscriptions_.rehash(0);
+	for (auto const& it : sharedSchedules_) {
+		// subscribers of a firing schedule are being walked
+		if (!it.second->firing_) {
+			CompactSubscribers(*it.second);
+			it.second->subscribers_.shrink_to_fit();
+		}
+	}
+	slots_.shrink_to_fit();
+	freeSlots_.shrink_to_fit();
+	container_->Compact();
 }
 
-template <class Key, class Hash>
-void Scheduler<Key, Hash>::ScheduleWithDelay(
-			Key const& alias, TimeUnit delayInMillis, ECPtr&& cb) {
-	Schedule(alias, clock_->Now() + delayInMillis, std::move(cb));
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::SetJournal(std::shared_ptr<JobJournal<Key>> journal) {
+	journal_ = journal;
+	if (!journal_) {
+		return;
+	}
+	journal_->Clear();
+	// immediate jobs hold their drain epoch, anything not in the future is due now
+	auto now = clock_->Now();
+	std::unordered_map<JobId, TimeUnit> expires;
+	container_->IterJobs([&expires, now](Job const& job) {
+		expires.emplace(job.id_, std::max(job.expire_, now));
+		return true;
+	});
+	for (auto const& job : jobs_) {
+		auto found = expires.find(job.id_);
+		journal_->Set(job.alias_, found == expires.end() ? 0 : found->second);
+	}
+	journal_->Publish();
 }
 
-template <class Key, class Hash>
-void Scheduler<Key, Hash>::ScheduleAt(
-			Key const& alias, size_t hour, size_t minute, size_t second, ECPtr&& cb) {
-	crontab::Crontab cron;
-	cron.Parse(hour, minute, second);
-	auto expireTime = cron.NextExpire(*clock_);
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+size_t Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::CancelGroup(GroupTag group) {
+	auto& groupIndex = boost::multi_index::get<elapse::group>(jobs_);
+	auto range = groupIndex.equal_range(group);
+	size_t nCancelled = 0;
+	for (auto it = range.first; it != range.second; ++it, ++nCancelled) {
+		// a firing repeat job (id 0) is dropped by its container after the callback
+		if (it->id_) {
+			RemoveJob(it->id_);
+		}
+		ReleaseSlot(*it);
+		if (auto journal = Journaling()) {
+			journal->Erase(it->alias_);
+		}
+	}
+	groupIndex.erase(range.first, range.second);
+	return nCancelled;
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+size_t Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::CountGroup(GroupTag group) const {
+	return boost::multi_index::get<elapse::group>(jobs_).count(group);
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+template <class Predicate>
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::IterGroup(GroupTag group, Predicate&& pred) const {
+	auto range = boost::multi_index::get<elapse::group>(jobs_).equal_range(group);
+	for (auto it = range.first; it != range.second; ++it) {
+		if (!pred(it->alias_)) {
+			break;
+		}
+	}
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::ScheduleWithDelay(
+			Key const& alias, TimeUnit delay, ECPtr&& cb, GroupTag group) {
+	if (!delay) {
+		ScheduleNextTick(alias, std::move(cb), group);
+		return;
+	}
+	Schedule(alias, clock_->Now() + delay, std::move(cb), group);
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::ScheduleNextTick(Key const& alias, ECPtr&& cb, GroupTag group) {
+	auto callback = NewCallback<ECOneTimeSchedule<Scheduler>>(std::move(cb));
+	auto id = container_->AddImmediate(ECPtr(callback), group);
+	if (Group()) {
+		OnScheduled(clock_->ToBaseTime(clock_->Now()));
+	}
+	typename map_type::iterator it;
+	auto replaced = BindJob(alias, id, clock_->Now(), group, Repeat(), &it);
+	callback->Bind(&*it);
+	if (replaced) {
+		RemoveJob(replaced);
+	}
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::ScheduleAt(
+			Key const& alias, size_t hour, size_t minute, size_t second, ECPtr&& cb, GroupTag group) {
+	auto next = calendar_.NextDaily(clock_->NowTimeT(), hour, minute, second);
+	crontab::CronSpec cron;
+	if (!next) {
+		cron.Parse(hour, minute, second);
+	}
+	ScheduleAtTime(alias, next, cron, std::move(cb), group);
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::ScheduleWeeklyAt(
+			Key const& alias, size_t week, size_t hour, size_t minute, size_t second, ECPtr&& cb, GroupTag group) {
+	auto next = calendar_.NextWeekly(clock_->NowTimeT(), week, hour, minute, second);
+	crontab::CronSpec cron;
+	if (!next) {
+		cron.Parse(week, hour, minute, second);
+	}
+	ScheduleAtTime(alias, next, cron, std::move(cb), group);
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::ScheduleAtDate(
+			Key const& alias, size_t month, size_t date, size_t hour, size_t minute, size_t second, ECPtr&& cb,
+			GroupTag group) {
+	auto next = calendar_.NextDate(clock_->NowTimeT(), month, date, hour, minute, second);
+	crontab::CronSpec cron;
+	if (!next) {
+		cron.Parse(month, date, hour, minute, second);
+	}
+	ScheduleAtTime(alias, next, cron, std::move(cb), group);
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::ScheduleAtTime(
+			Key const& alias, std::time_t next, crontab::CronSpec const& cron, ECPtr&& cb, GroupTag group) {
+	auto expireTime = next ? ToTimeUnit(next) : cron.NextExpire(*clock_);
 	if (!expireTime) {
 		return;
 	}
-	Schedule(alias, expireTime, std::move(cb));
+	Schedule(alias, expireTime, std::move(cb), group);
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+template <class Functor>
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::ScheduleLambda(Key const& alias, TimeUnit expireTime, Functor&& cb, GroupTag group) {
+	Schedule(alias, expireTime, WrapLambdaPtr(resource_, std::forward<Functor>(cb)), group);
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+template <class Functor>
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::ScheduleRepeatLambda(Key const& alias, Repeat const& repeatConfig, Functor&& cb,
+			PhaseSpread spread, GroupTag group) {
+	ScheduleRepeat(alias, repeatConfig, WrapLambdaPtr(resource_, std::forward<Functor>(cb)), spread, group);
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+template <class Functor>
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::ScheduleSharedLambda(Key const& alias, Key const& schedule,
+			Repeat const& repeatConfig, Functor&& cb, GroupTag group) {
+	ScheduleShared(alias, schedule, repeatConfig, WrapLambdaPtr(resource_, std::forward<Functor>(cb)), group);
 }
 
-template <class Key, class Hash>
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
 template <class Functor>
-void Scheduler<Key, Hash>::ScheduleLambda(Key const& alias, TimeUnit expireTime, Functor&& cb) {
-	Schedule(alias, expireTime, ELAPSE_CB_LAMBDA_WRAPPER(cb));
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::ScheduleWithDelayLambda(Key const& alias, TimeUnit delay, Functor&& cb,
+			GroupTag group) {
+	ScheduleWithDelay(alias, delay, WrapLambdaPtr(resource_, std::forward<Functor>(cb)), group);
 }
 
-template <class Key, class Hash>
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
 template <class Functor>
-void Scheduler<Key, Hash>::ScheduleRepeatLambda(Key const& alias, crontab::RepeatablePtr const& repeatConfig, Functor&& cb) {
-	ScheduleRepeat(alias, repeatConfig, ELAPSE_CB_LAMBDA_WRAPPER(cb));
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::ScheduleAtLambda(Key const& alias, size_t hour, size_t minute, size_t second, Functor&& cb,
+			GroupTag group) {
+	ScheduleAt(alias, hour, minute, second, WrapLambdaPtr(resource_, std::forward<Functor>(cb)), group);
 }
 
-template <class Key, class Hash>
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
 template <class Functor>
-void Scheduler<Key, Hash>::ScheduleWithDelayLambda(Key const& alias, TimeUnit delayInMillis, Functor&& cb) {
-	ScheduleWithDelay(alias, delayInMillis, ELAPSE_CB_LAMBDA_WRAPPER(cb));
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::ScheduleWeeklyAtLambda(Key const& alias, size_t week, size_t hour, size_t minute,
+			size_t second, Functor&& cb, GroupTag group) {
+	ScheduleWeeklyAt(alias, week, hour, minute, second, WrapLambdaPtr(resource_, std::forward<Functor>(cb)), group);
 }
 
-template <class Key, class Hash>
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
 template <class Functor>
-void Scheduler<Key, Hash>::ScheduleAtLambda(Key const& alias, size_t hour, size_t minute, size_t second, Functor&& cb) {
-	ScheduleAt(alias, hour, minute, second, ELAPSE_CB_LAMBDA_WRAPPER(cb));
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::ScheduleAtDateLambda(Key const& alias, size_t month, size_t date, size_t hour,
+			size_t minute, size_t second, Functor&& cb, GroupTag group) {
+	ScheduleAtDate(alias, month, date, hour, minute, second, WrapLambdaPtr(resource_, std::forward<Functor>(cb)), group);
 }
 
-template <class Key, class Hash>
-bool Scheduler<Key, Hash>::ReplaceJob(
-			Key const& alias, TimeUnit expireTime, crontab::RepeatablePtr const& repeatConfig, ECPtr&& wrappedCallback) {
-	auto id = container_->Add(std::max(expireTime, clock_->Now() + 1), std::move(wrappedCallback));
-	bool isInserted;
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+typename Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::map_type::iterator Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::ReplaceJob(
+			Key const& alias, TimeUnit expireTime, Repeat&& repeatConfig, ECPtr&& wrappedCallback, GroupTag group) {
+	expireTime = std::max(expireTime, clock_->Now() + 1);
+	auto id = container_->Add(expireTime, std::move(wrappedCallback), group);
+	if (Group()) {
+		OnScheduled(clock_->ToBaseTime(expireTime));
+	}
 	typename map_type::iterator it;
-	std::tie(it, isInserted) = jobs_.insert(std::make_pair(alias, std::make_pair(id, repeatConfig)));
-	if (isInserted) {
+	auto replaced = BindJob(alias, id, expireTime, group, std::move(repeatConfig), &it);
+	if (replaced) {
+		RemoveJob(replaced);
+	}
+	return it;
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+JobId Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::BindJob(Key const& alias, JobId id, TimeUnit expireTime,
+			GroupTag group, Repeat&& repeatConfig, typename map_type::iterator* bound) {
+	if (auto journal = Journaling()) {
+		journal->Set(alias, expireTime);
+	}
+	// look up first, emplace builds a node even when the alias is taken
+	auto it = jobs_.find(alias);
+	if (it == jobs_.end()) {
+		it = jobs_.emplace(alias, id, group, repeatConfig).first;
+		if (bound) {
+			*bound = it;
+		}
+		return 0;
+	}
+	if (bound) {
+		*bound = it;
+	}
+	// handles refer to the replaced call
+	ReleaseSlot(*it);
+	auto replaced = it->id_;
+	it->id_ = id;
+	it->repeat_ = std::move(repeatConfig);
+	if (it->group_ != group) {
+		jobs_.modify(it, [group](value_type& job) { job.group_ = group; });
+	}
+	return replaced;
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::ScheduleBatch(
+			std::vector<item_type>&& items, bool withDelay) {
+	if (items.empty()) {
+		return;
+	}
+	auto now = clock_->Now();
+	auto base = withDelay ? now : 0;
+	auto minExpire = now + 1;
+	std::vector<BatchJob> batch;
+	std::vector<ECOneTimeSchedule<Scheduler>*> callbacks;
+	batch.reserve(items.size());
+	callbacks.reserve(items.size());
+	auto earliest = std::numeric_limits<TimeUnit>::max();
+	for (auto& item : items) {
+		auto expireTime = std::max(base + item.expire_, minExpire);
+		earliest = std::min(earliest, expireTime);
+		callbacks.push_back(NewCallback<ECOneTimeSchedule<Scheduler>>(std::move(item.cb_)));
+		batch.emplace_back(expireTime, ECPtr(callbacks.back()), item.group_);
+	}
+	container_->AddBatch(batch);
+	if (Group()) {
+		OnScheduled(clock_->ToBaseTime(earliest));
+	}
+	jobs_.reserve(jobs_.size() + items.size());
+	boost::multi_index::get<elapse::group>(jobs_).reserve(jobs_.size() + items.size());
+	std::vector<JobId> replaced;
+	for (size_t i = 0; i < items.size(); ++i) {
+		typename map_type::iterator it;
+		auto id = BindJob(items[i].alias_, batch[i].id_, batch[i].expire_, items[i].group_, Repeat(), &it);
+		callbacks[i]->Bind(&*it);
+		if (id) {
+			replaced.push_back(id);
+		}
+	}
+	if (!replaced.empty()) {
+		RemoveJobs(replaced);
+	}
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::RemoveJob(JobId id) {
+	if (!batchJobs_.empty()) {
+		batchJobs_.erase(id);
+	}
+	container_->Remove(id);
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::RemoveJobs(std::vector<JobId> const& ids) {
+	if (!batchJobs_.empty()) {
+		for (auto id : ids) {
+			batchJobs_.erase(id);
+		}
+	}
+	container_->RemoveBatch(ids);
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+bool Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::RearmJob(typename map_type::iterator it, JobId id) {
+	auto expireTime = crontab::NextExpire(it->repeat_, *clock_);
+	if (!expireTime) {
+		// the container drops the fired job after its callback returns
+		EraseJob(it);
 		return false;
 	}
-	container_->Remove(it->second.first);
-	it->second = std::make_pair(id, repeatConfig);
+	expireTime = std::max(expireTime, clock_->Now() + 1);
+	container_->Reschedule(id, expireTime);
+	it->id_ = id;
+	if (auto journal = Journaling()) {
+		journal->Set(it->alias_, expireTime);
+	}
 	return true;
 }
 
-template <class Key, class Hash>
-bool Scheduler<Key, Hash>::OnTriggered(Key const& alias, JobId id) {
-	auto it = jobs_.find(alias);
-	if (it != jobs_.end()) {
-		jobs_.erase(it);
-		return true;
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+bool Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::OnTriggered(value_type const* job, JobId id) {
+	if (job->id_ != id) {
+		return false;
 	}
-	return false;
+	EraseJob(jobs_.iterator_to(*job));
+	return true;
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+JobJournal<Key>* Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::Journaling() {
+	if (journal_ && Group() && !journal_->Pending()) {
+		OnScheduled(Group()->GetClock().Now());
+	}
+	return journal_.get();
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::EraseJob(typename map_type::iterator it) {
+	if (auto journal = Journaling()) {
+		journal->Erase(it->alias_);
+	}
+	ReleaseSlot(*it);
+	jobs_.erase(it);
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+bool Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::CancelJob(typename map_type::iterator it) {
+	if (it == jobs_.end()) {
+		return false;
+	}
+	if (it->id_) {
+		RemoveJob(it->id_);
+	}
+	EraseJob(it);
+	return true;
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+template <class CompatibleKey>
+typename Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::map_type::iterator Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::FindAlias(CompatibleKey const& alias) {
+	return jobs_.find(alias, jobs_.hash_function(), std::equal_to<>());
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+template <class CompatibleKey>
+typename Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::map_type::const_iterator Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::FindAlias(
+			CompatibleKey const& alias) const {
+	return jobs_.find(alias, jobs_.hash_function(), std::equal_to<>());
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+JobHandle Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::MakeHandle(value_type const& job) {
+	if (!job.slot_) {
+		std::uint32_t slot;
+		if (freeSlots_.empty()) {
+			slot = static_cast<std::uint32_t>(slots_.size());
+			slots_.push_back(HandleSlot{nullptr, 1});
+		} else {
+			slot = freeSlots_.back();
+			freeSlots_.pop_back();
+		}
+		slots_[slot].job_ = &job;
+		job.slot_ = slot + 1;
+	}
+	return JobHandle(job.slot_ - 1, slots_[job.slot_ - 1].generation_);
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::ReleaseSlot(value_type const& job) {
+	if (!job.slot_) {
+		return;
+	}
+	if (!subscriptions_.empty()) {
+		Unsubscribe(job.slot_ - 1);
+	}
+	auto& slot = slots_[job.slot_ - 1];
+	slot.job_ = nullptr;
+	if (++slot.generation_ == 0) {
+		slot.generation_ = 1;
+	}
+	freeSlots_.push_back(job.slot_ - 1);
+	job.slot_ = 0;
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+typename Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::value_type const* Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::Resolve(JobHandle handle) const {
+	if (handle.slot_ >= slots_.size()) {
+		return nullptr;
+	}
+	auto const& slot = slots_[handle.slot_];
+	return slot.generation_ == handle.generation_ ? slot.job_ : nullptr;
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+bool Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::RescheduleJob(value_type const& job, TimeUnit expireTime) {
+	// a firing repeat job is re-armed from its repeat config
+	if (!job.id_) {
+		return false;
+	}
+	expireTime = std::max(expireTime, clock_->Now() + 1);
+	if (!container_->Reschedule(job.id_, expireTime)) {
+		return false;
+	}
+	if (auto journal = Journaling()) {
+		journal->Set(job.alias_, expireTime);
+	}
+	if (Group()) {
+		OnScheduled(clock_->ToBaseTime(expireTime));
+	}
+	return true;
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::FireShared(SharedSchedule& shared, JobId id) {
+	auto& subscribers = shared.subscribers_;
+	bool destroyFlag = false;
+	destroyFlag_ = &destroyFlag;
+	shared.firing_ = true;
+	// subscribers joining from a callback wait for the next firing
+	for (size_t i = 0, n = subscribers.size(); i < n && i < subscribers.size(); ++i) {
+		if (!subscribers[i].cb_) {
+			continue;
+		}
+		// the callback may cancel its own subscription
+		auto handle = subscribers[i].handle_;
+		ECPtr cb = std::move(subscribers[i].cb_);
+		(*cb)(id);
+		if (destroyFlag) {
+			return;
+		}
+		if (i < subscribers.size() && subscribers[i].handle_ == handle && Resolve(handle)) {
+			subscribers[i].cb_ = std::move(cb);
+		}
+	}
+	destroyFlag_ = nullptr;
+	shared.firing_ = false;
+	CompactSubscribers(shared);
+
+	auto expireTime = subscribers.empty() ? 0 : crontab::NextExpire(shared.repeat_, *clock_);
+	if (expireTime) {
+		container_->Reschedule(id, std::max(expireTime, clock_->Now() + 1));
+		return;
+	}
+	// finished, the container drops the fired job after its callback returns
+	for (auto const& subscriber : subscribers) {
+		subscriptions_.erase(subscriber.handle_.slot_);
+		EraseJob(jobs_.iterator_to(*Resolve(subscriber.handle_)));
+	}
+	sharedSchedules_.erase(sharedSchedules_.find(shared.name_));
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::Unsubscribe(std::uint32_t slot) {
+	auto found = subscriptions_.find(slot);
+	if (found == subscriptions_.end()) {
+		return;
+	}
+	auto& shared = *found->second.shared_;
+	// a firing callback is held by FireShared and dropped there
+	shared.subscribers_[found->second.index_].cb_.reset();
+	subscriptions_.erase(found);
+	--shared.live_;
+	// a firing schedule is compacted, or dropped, by FireShared
+	if (shared.firing_) {
+		return;
+	}
+	if (shared.live_) {
+		if (shared.subscribers_.size() > 2 * shared.live_ + 16) {
+			CompactSubscribers(shared);
+		}
+		return;
+	}
+	container_->Remove(shared.id_);
+	sharedSchedules_.erase(sharedSchedules_.find(shared.name_));
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+void Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::CompactSubscribers(SharedSchedule& shared) {
+	auto& subscribers = shared.subscribers_;
+	if (subscribers.size() == shared.live_) {
+		return;
+	}
+	subscribers.erase(std::remove_if(subscribers.begin(), subscribers.end(), [](SharedSubscriber const& subscriber) {
+		return !subscriber.cb_;
+	}), subscribers.end());
+	for (size_t i = 0; i < subscribers.size(); ++i) {
+		subscriptions_[subscribers[i].handle_.slot_].index_ = i;
+	}
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+TimeUnit Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::SpreadPhase(Key const& alias, TimeUnit period, PhaseSpread spread) {
+	std::uint64_t x = 0;
+	if (spread == PhaseSpread::Even) {
+		// golden ratio sequence, any prefix of it covers the period evenly
+		x = spreadCounters_[period]++ * 0x9E3779B97F4A7C15ULL;
+	} else {
+		// splitmix64 finalizer, identity hashes of sequential keys still spread well
+		x = static_cast<std::uint64_t>(jobs_.hash_function()(alias));
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+		x ^= x >> 31;
+	}
+	auto phase = static_cast<TimeUnit>(static_cast<double>(x >> 11) / 9007199254740992.0 * period);
+	return 1 + std::min(phase, period - 1);
+}
+
+template <class Key, class Hash, class Repeat, class ContainerType, class ClockType>
+template <class Callback>
+Callback* Scheduler<Key, Hash, Repeat, ContainerType, ClockType>::NewCallback(ECPtr&& cb) {
+#ifdef SCHEDULER_USE_POOL_ALLOCATOR
+	// the wrappers come from their own pools
+	return new Callback(this, std::move(cb));
+#else
+	return new (resource_) Callback(this, std::move(cb));
+#endif
 }
 
-} // namespace elapse
+} // namespace elapse
\ No newline at end of file
@@ -0,0 +1,133 @@
+#pragma once
+/*
+Author: ywx217@gmail.com
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/heap/d_ary_heap.hpp>
+#include "JobCommons.hpp"
+#include "Clock.hpp"
+
+
+namespace elapse {
+
+class SchedulerBase;
+class SchedulerGroup;
+
+namespace detail {
+
+struct GroupEntry {
+	TimeUnit deadline;
+	SchedulerBase* member;
+};
+
+struct GroupEntryLater {
+	bool operator()(GroupEntry const& lhs, GroupEntry const& rhs) const {
+		return lhs.deadline > rhs.deadline;
+	}
+};
+
+// min-heap of member deadlines
+typedef boost::heap::d_ary_heap<
+	GroupEntry,
+	boost::heap::arity<4>,
+	boost::heap::mutable_<true>,
+	boost::heap::compare<GroupEntryLater>
+> GroupHeap;
+
+} // namespace detail
+
+// the clock independent part of a Scheduler, driven by a SchedulerGroup
+class SchedulerBase : private boost::noncopyable {
+public:
+	SchedulerBase() : group_(nullptr) {}
+	virtual ~SchedulerBase();
+
+	// bookkeeping all scheduled jobs
+	virtual void Tick() = 0;
+	// earliest deadline translated to the base clock, 0 if nothing is scheduled
+	virtual TimeUnit NextDeadline() const = 0;
+
+	SchedulerGroup* Group() const { return group_; }
+	// re-register the deadline after it moved without a schedule call,
+	// e.g. resuming or speeding up a DomainClock
+	void RefreshDeadline();
+
+protected:
+	// a job was scheduled at `deadline` on the base clock
+	void OnScheduled(TimeUnit deadline);
+
+private:
+	friend class SchedulerGroup;
+	SchedulerGroup* group_;
+	detail::GroupHeap::handle_type groupHandle_;
+};
+
+// drives many schedulers from one loop, only the schedulers with due jobs are
+// ticked. members report earlier deadlines automatically when jobs are
+// scheduled; cancelled jobs leave a stale earlier deadline behind, which costs
+// one spurious tick of that member. members are expected to share the group's
+// clock, or to run on a DomainClock based on it.
+class SchedulerGroup : private boost::noncopyable {
+public:
+	static const TimeUnit NoDeadline = std::numeric_limits<TimeUnit>::max();
+
+public:
+	explicit SchedulerGroup(std::shared_ptr<Clock> clock) : clock_(clock), destroyFlag_(nullptr) {}
+	virtual ~SchedulerGroup();
+
+	// a scheduler belongs to at most one group, joining moves it
+	void Add(SchedulerBase& member);
+	bool Remove(SchedulerBase& member);
+	size_t Size() const { return heap_.size(); }
+
+	// ticks the members that are due, returns the number of members ticked
+	size_t Tick();
+	// earliest deadline of all members, NoDeadline if none
+	TimeUnit NextDeadline() const;
+	Clock const& GetClock() const { return *clock_; }
+
+protected:
+	friend class SchedulerBase;
+	// set the exact deadline of a member
+	void Update(SchedulerBase& member, TimeUnit deadline);
+	// move the deadline of a member earlier only
+	void Lower(SchedulerBase& member, TimeUnit deadline);
+
+protected:
+	std::shared_ptr<Clock> clock_;
+	detail::GroupHeap heap_;
+	// members being ticked, removed members are reset to nullptr
+	std::vector<SchedulerBase*> due_;
+	bool *destroyFlag_;
+};
+
+} // namespace elapse
\ No newline at end of file
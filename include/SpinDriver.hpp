@@ -0,0 +1,103 @@
+#pragma once
+/*
+Author: ywx217@gmail.com
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include "JobCommons.hpp"
+#include "Clock.hpp"
+#include "LatencyStats.hpp"
+#include "SchedulerGroup.hpp"
+
+
+namespace elapse {
+
+// low latency loop for a dedicated core. far deadlines are slept on, the last
+// stretch before a deadline is busy-polled on the steady clock, then the
+// driven clock is refreshed and the scheduler ticked. the wakeup latency of
+// every tick (tick start minus deadline) is sampled in nanoseconds.
+//
+// `clock` is the clock the deadlines are read on: the scheduler's own clock,
+// or the group's base clock. Scheduler::NextDeadline is in base time, so a
+// scheduler's DomainClock is read through DomainClock::Base() instead. the
+// clock is refreshed with Advance(0) before each tick, which keeps a LazyClock
+// current.
+class SpinDriver : private boost::noncopyable {
+public:
+	typedef std::chrono::steady_clock steady_clock;
+
+public:
+	SpinDriver(SchedulerBase& scheduler, Clock& clock);
+	SpinDriver(SchedulerGroup& group, Clock& clock);
+
+	// deadlines closer than `window` are busy-polled, 200us by default
+	void SetSpinWindow(std::chrono::nanoseconds window) { spinWindow_ = window; }
+	// longest single sleep, bounds the reaction to Stop() and to jobs added from
+	// other code between ticks, 10ms by default
+	void SetMaxSleep(std::chrono::nanoseconds sleep) { maxSleep_ = sleep; }
+
+	// waits for the next deadline (at most the max sleep) and ticks if it is due,
+	// returns true if it ticked
+	bool RunOnce();
+	// runs until Stop()
+	void Run();
+	// callable from callbacks and other threads
+	void Stop() { stopped_ = true; }
+	bool Stopped() const { return stopped_; }
+
+	// pins the calling thread to `cpu`, false if unsupported or refused
+	static bool PinCurrentThread(int cpu);
+
+	// latency of the last sampled wakeups, in nanoseconds
+	LatencyStats WakeupLatency() const;
+	size_t Ticks() const { return ticks_; }
+	void ResetStats();
+
+private:
+	// next deadline on the clock, 0 if nothing is scheduled
+	TimeUnit NextDeadline() const;
+	void Record(std::uint64_t latency);
+
+private:
+	std::function<void()> tick_;
+	std::function<TimeUnit()> nextDeadline_;
+	Clock& clock_;
+	std::chrono::nanoseconds spinWindow_;
+	std::chrono::nanoseconds maxSleep_;
+	std::atomic<bool> stopped_;
+	size_t ticks_;
+	// ring of the latest samples
+	std::vector<std::uint64_t> samples_;
+	size_t nextSample_;
+};
+
+} // namespace elapse
\ No newline at end of file
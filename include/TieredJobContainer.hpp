@@ -0,0 +1,100 @@
+#pragma once
+/*
+Author: ywx217@gmail.com
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#include <vector>
+#include "JobContainer.hpp"
+#include "TreeJobContainer.hpp"
+
+
+namespace elapse {
+
+// two TreeJobContainers split by expire time: jobs due before Limit() live in
+// the hot tier that PopExpires works on, later ones wait in the cold tier.
+// PopExpires promotes the cold jobs of the next `horizon` time units in one
+// batch once half of the previous window has passed, so the hot index holds
+// little more than a window of jobs. the first window starts at the first
+// PopExpires, or at Start, until then every job is hot. jobs keep their ids
+// across tiers.
+class TieredJobContainer final : public JobContainer {
+public:
+	explicit TieredJobContainer(TimeUnit horizon = 60 * kTimeUnitsPerSecond,
+		MemoryResource* resource = DefaultResource()) :
+		hot_(resource),
+		cold_(resource),
+		horizon_(horizon),
+		limit_(0) {}
+	virtual ~TieredJobContainer() {}
+
+	virtual JobId Add(TimeUnit expireTime, ECPtr&& cb) { return Add(expireTime, std::move(cb), NullGroup); }
+	virtual JobId Add(TimeUnit expireTime, ECPtr&& cb, GroupTag group);
+	virtual JobId AddImmediate(ECPtr&& cb, GroupTag group) { return hot_.AddImmediate(std::move(cb), group); }
+	virtual JobId AddBatched(TimeUnit expireTime, BatchExpireCallback* sink, GroupTag group);
+	virtual void AddBatch(std::vector<BatchJob>& jobs);
+	virtual void RemoveSink(BatchExpireCallback* sink) {
+		hot_.RemoveSink(sink);
+		cold_.RemoveSink(sink);
+	}
+	virtual bool Remove(JobId handle) { return hot_.Remove(handle) || cold_.Remove(handle); }
+	virtual size_t RemoveBatch(std::vector<JobId> const& handles);
+	virtual bool Reschedule(JobId handle, TimeUnit expireTime);
+	virtual void RemoveAll();
+	virtual size_t PopExpires(TimeUnit now);
+	virtual void IterJobs(JobPredicate pred) const;
+	virtual void RemoveJobs(JobPredicate pred);
+	virtual size_t RemoveJobsStep(RemoveCursor& cursor, JobPredicate pred, size_t budget);
+	virtual size_t RemoveGroup(GroupTag group) { return hot_.RemoveGroup(group) + cold_.RemoveGroup(group); }
+	virtual size_t CountGroup(GroupTag group) const { return hot_.CountGroup(group) + cold_.CountGroup(group); }
+	virtual void IterGroup(GroupTag group, JobPredicate pred) const;
+	virtual size_t Size() const { return hot_.Size() + cold_.Size(); }
+	virtual TimeUnit EarliestExpire() const;
+	virtual MemoryUsage Memory() const;
+	virtual void Compact();
+
+	TreeJobContainer const& Hot() const { return hot_; }
+	TreeJobContainer const& Cold() const { return cold_; }
+	// jobs expiring from here on are kept cold, 0 before the first window
+	TimeUnit Limit() const { return limit_; }
+	TimeUnit Horizon() const { return horizon_; }
+	// starts a window at `now`, splitting the jobs between the tiers again
+	void Start(TimeUnit now);
+
+protected:
+	bool IsCold(TimeUnit expireTime) const { return limit_ && expireTime >= limit_; }
+	// moves a hot job on to the cold tier if it is due past the limit
+	void Place(JobId id, TimeUnit expireTime);
+
+protected:
+	// both tiers take their ids from the hot one
+	TreeJobContainer hot_;
+	TreeJobContainer cold_;
+	TimeUnit horizon_;
+	TimeUnit limit_;
+};
+
+} // namespace elapse
\ No newline at end of file
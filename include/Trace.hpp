@@ -0,0 +1,165 @@
+#pragma once
+/*
+Author: ywx217@gmail.com
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <unordered_map>
+#include "JobCommons.hpp"
+#include "JobContainer.hpp"
+#include "Job.hpp"
+#include "Clock.hpp"
+
+
+namespace elapse {
+
+// operations of a workload trace
+enum class TraceOp : std::uint8_t {
+	// id, expire, group
+	Add = 1,
+	AddBatched,
+	// id, group
+	AddImmediate,
+	// id
+	Remove,
+	// id, expire
+	Reschedule,
+	RemoveAll,
+	// group
+	RemoveGroup,
+	// PopExpires(time) begins, the Fire events of its callbacks follow
+	Tick,
+	// id, events up to the next Fire or TickEnd come from its callback
+	Fire,
+	TickEnd,
+};
+
+struct TraceEvent {
+	TraceOp op_;
+	TimeUnit time_;
+	JobId id_;
+	TimeUnit expire_;
+	GroupTag group_;
+
+	bool operator==(TraceEvent const& rhs) const {
+		return op_ == rhs.op_ && time_ == rhs.time_ && id_ == rhs.id_ && expire_ == rhs.expire_ && group_ == rhs.group_;
+	}
+};
+
+// binary trace: a magic header, then one op byte per event followed by only
+// the fields it uses as varints. times are deltas to the previous event and
+// expire times are zigzag deltas to the event time.
+class TraceWriter {
+public:
+	explicit TraceWriter(std::ostream& os);
+
+	void Write(TraceOp op, TimeUnit time, JobId id = 0, TimeUnit expire = 0, GroupTag group = NullGroup);
+	// time of the last event, used for events without a clock
+	TimeUnit LastTime() const { return lastTime_; }
+	size_t Count() const { return count_; }
+
+private:
+	void WriteVarint(std::uint64_t value);
+
+private:
+	std::ostream& os_;
+	TimeUnit lastTime_;
+	size_t count_;
+};
+
+class TraceReader {
+public:
+	explicit TraceReader(std::istream& is);
+
+	// false if the stream does not start with a trace header
+	bool Valid() const { return valid_; }
+	// false at the end of the trace or on a truncated event
+	bool Next(TraceEvent& event);
+
+private:
+	bool ReadVarint(std::uint64_t& value);
+
+private:
+	std::istream& is_;
+	TimeUnit lastTime_;
+	bool valid_;
+};
+
+// container decorator logging every mutation to a trace. callbacks and batch
+// sinks are wrapped to log their firing, so the events issued from them replay
+// in place. the events of a sink follow the last job of its batch.
+// a Scheduler records through it as its container, a replace shows up as
+// Add + Remove.
+class RecordingJobContainer final : public JobContainer {
+public:
+	// events are stamped with `clock` if given, otherwise with the last tick time
+	RecordingJobContainer(std::shared_ptr<JobContainer> inner, std::shared_ptr<TraceWriter> writer,
+		std::shared_ptr<Clock> clock = nullptr);
+	virtual ~RecordingJobContainer() {}
+
+	virtual JobId Add(TimeUnit expireTime, ECPtr&& cb);
+	virtual JobId Add(TimeUnit expireTime, ECPtr&& cb, GroupTag group);
+	virtual JobId AddImmediate(ECPtr&& cb, GroupTag group);
+	virtual JobId AddBatched(TimeUnit expireTime, BatchExpireCallback* sink, GroupTag group);
+	virtual void AddBatch(std::vector<BatchJob>& jobs);
+	virtual void RemoveSink(BatchExpireCallback* sink);
+	virtual bool Remove(JobId handle);
+	virtual size_t RemoveBatch(std::vector<JobId> const& handles);
+	virtual bool Reschedule(JobId handle, TimeUnit expireTime);
+	virtual void RemoveAll();
+	virtual size_t PopExpires(TimeUnit now);
+	virtual void IterJobs(JobPredicate pred) const { inner_->IterJobs(pred); }
+	virtual void RemoveJobs(JobPredicate pred);
+	virtual size_t RemoveJobsStep(RemoveCursor& cursor, JobPredicate pred, size_t budget);
+	virtual size_t RemoveGroup(GroupTag group);
+	virtual size_t CountGroup(GroupTag group) const { return inner_->CountGroup(group); }
+	virtual void IterGroup(GroupTag group, JobPredicate pred) const { inner_->IterGroup(group, pred); }
+	virtual size_t Size() const { return inner_->Size(); }
+	virtual TimeUnit EarliestExpire() const { return inner_->EarliestExpire(); }
+	virtual MemoryUsage Memory() const { return inner_->Memory(); }
+	virtual void Compact() { inner_->Compact(); }
+
+	std::shared_ptr<JobContainer> const& Inner() const { return inner_; }
+	std::shared_ptr<TraceWriter> const& Writer() const { return writer_; }
+
+private:
+	TimeUnit Now() const;
+	ECPtr Wrap(ECPtr&& cb);
+	BatchExpireCallback* WrapSink(BatchExpireCallback* sink);
+
+private:
+	std::shared_ptr<JobContainer> inner_;
+	std::shared_ptr<TraceWriter> writer_;
+	std::shared_ptr<Clock> clock_;
+	// logging sink in the inner container for each sink
+	std::unordered_map<BatchExpireCallback*, std::unique_ptr<BatchExpireCallback>> sinks_;
+};
+
+} // namespace elapse
\ No newline at end of file
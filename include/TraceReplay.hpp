@@ -0,0 +1,77 @@
+#pragma once
+/*
+Author: ywx217@gmail.com
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <vector>
+#include "JobCommons.hpp"
+#include "JobContainer.hpp"
+#include "LatencyStats.hpp"
+#include "Trace.hpp"
+
+
+namespace elapse {
+
+struct ReplayStats {
+	size_t events_;
+	size_t ticks_;
+	size_t fires_;
+	// fires of the trace missing from the replay, and replay fires not in the trace
+	size_t missedFires_;
+	size_t extraFires_;
+	size_t peakJobs_;
+	// peak bytes allocated from the container's memory resource
+	size_t peakBytes_;
+	// wall time spent inside container calls
+	double seconds_;
+	// container call latencies in nanoseconds, a tick includes its callbacks
+	LatencyStats add_;
+	LatencyStats remove_;
+	LatencyStats reschedule_;
+	LatencyStats tick_;
+	// tick time - expire time of the fired jobs, in time units
+	LatencyStats lateness_;
+
+	double EventsPerSecond() const { return seconds_ > 0 ? events_ / seconds_ : 0; }
+};
+
+// builds the container under test on the given memory resource
+typedef std::function<std::unique_ptr<JobContainer>(MemoryResource*)> ContainerFactory;
+
+// reads a whole trace, false if the stream is not a trace
+bool LoadTrace(std::istream& is, std::vector<TraceEvent>& events);
+// replays a recorded trace against a fresh container, the trace time acts as the clock.
+// events recorded inside a callback are replayed from the callback of the same job.
+ReplayStats ReplayTrace(std::vector<TraceEvent> const& events, ContainerFactory const& factory);
+void PrintReplayStats(std::ostream& os, ReplayStats const& stats);
+
+} // namespace elapse
\ No newline at end of file
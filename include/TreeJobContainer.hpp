@@ -33,11 +33,15 @@ For more information, please refer to <http://unlicense.org>
 #endif
 
 #include <set>
+#include <utility>
+#include <vector>
 #include <unordered_map>
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/member.hpp>
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index/hashed_index.hpp>
+#include <boost/multi_index/sequenced_index.hpp>
+#include <boost/container/pmr/polymorphic_allocator.hpp>
 #include "Job.hpp"
 #include "JobContainer.hpp"
 
@@ -58,6 +62,7 @@ struct expire {};
 /* Define a multi_index_container of JobSet with following indices:
 *   - a unique index sorted by Job::id_,
 *   - a non-unique index sorted by Job::expired_,
+*   - a non-unique hashed index by Job::group_,
 */
 
 
@@ -67,24 +72,81 @@ typedef boost::multi_index_container<
 		boost::multi_index::hashed_unique<
 			boost::multi_index::tag<id>, BOOST_MULTI_INDEX_MEMBER(Job, JobId, id_)>,
 		boost::multi_index::ordered_non_unique<
-			boost::multi_index::tag<expire>, BOOST_MULTI_INDEX_MEMBER(Job, TimeUnit, expire_)> >
+			boost::multi_index::tag<expire>, BOOST_MULTI_INDEX_MEMBER(Job, TimeUnit, expire_)>,
+		boost::multi_index::hashed_non_unique<
+			boost::multi_index::tag<group>, BOOST_MULTI_INDEX_MEMBER(Job, GroupTag, group_)> >,
+	boost::container::pmr::polymorphic_allocator<Job>
 > JobSet;
 
+// FIFO of immediate jobs, Job::expire_ holds the drain epoch they were added in
+typedef boost::multi_index_container<
+	Job,
+	boost::multi_index::indexed_by<
+		boost::multi_index::sequenced<>,
+		boost::multi_index::hashed_unique<
+			boost::multi_index::tag<id>, BOOST_MULTI_INDEX_MEMBER(Job, JobId, id_)>,
+		boost::multi_index::hashed_non_unique<
+			boost::multi_index::tag<group>, BOOST_MULTI_INDEX_MEMBER(Job, GroupTag, group_)> >,
+	boost::container::pmr::polymorphic_allocator<Job>
+> ImmediateJobSet;
+
 // a job container based on boost::multi_index_container (RB-Tree & unordered map)
 class TreeJobContainer : public JobContainer {
 public:
-	TreeJobContainer() : nextId_(1), destroyFlag_(nullptr) {}
+	// job nodes and bucket arrays are allocated from `resource`
+	explicit TreeJobContainer(MemoryResource* resource = DefaultResource()) :
+		nextId_(1),
+		jobs_(JobSet::ctor_args_list(), JobSet::allocator_type(resource)),
+		immediates_(ImmediateJobSet::ctor_args_list(), ImmediateJobSet::allocator_type(resource)),
+		immediateEpoch_(1),
+		firingImmediate_(0),
+		destroyFlag_(nullptr) {}
 	virtual ~TreeJobContainer();
 
 	virtual JobId Add(TimeUnit expireTime, ECPtr&& cb);
+	virtual JobId Add(TimeUnit expireTime, ECPtr&& cb, GroupTag group);
+	virtual JobId AddImmediate(ECPtr&& cb, GroupTag group);
+	virtual JobId AddBatched(TimeUnit expireTime, BatchExpireCallback* sink, GroupTag group);
+	virtual void AddBatch(std::vector<BatchJob>& jobs);
+	virtual void RemoveSink(BatchExpireCallback* sink);
 	virtual bool Remove(JobId handle);
+	virtual size_t RemoveBatch(std::vector<JobId> const& handles);
+	virtual bool Reschedule(JobId handle, TimeUnit expireTime);
 	virtual void RemoveAll();
 	virtual size_t PopExpires(TimeUnit now);
 	virtual void IterJobs(JobPredicate pred) const;
 	virtual void RemoveJobs(JobPredicate pred);
-	virtual size_t Size() const { return jobs_.size(); }
+	virtual size_t RemoveJobsStep(RemoveCursor& cursor, JobPredicate pred, size_t budget);
+	virtual size_t RemoveGroup(GroupTag group);
+	virtual size_t CountGroup(GroupTag group) const;
+	virtual void IterGroup(GroupTag group, JobPredicate pred) const;
+	virtual size_t Size() const { return jobs_.size() + immediates_.size(); }
+	virtual TimeUnit EarliestExpire() const;
+	virtual MemoryUsage Memory() const;
+	virtual void Compact();
+
+	// moving timed jobs to another container with their ids and callbacks, no
+	// job is copied. both containers must allocate from the same memory resource
+	// and keep their ids apart, see TieredJobContainer.
+	// moves the jobs expiring before `limit`, returns the number moved
+	size_t MoveExpiring(TimeUnit limit, TreeJobContainer& to);
+	// moves the jobs expiring at or after `limit`, returns the number moved
+	size_t MoveExpiringFrom(TimeUnit limit, TreeJobContainer& to);
+	// false if `handle` is not a timed job of this container
+	bool MoveJob(JobId handle, TreeJobContainer& to);
+	// adding with an id taken from the NextId of the container sharing ids
+	void Add(JobId id, TimeUnit expireTime, ECPtr&& cb, GroupTag group);
+	void AddBatched(JobId id, TimeUnit expireTime, BatchExpireCallback* sink, GroupTag group);
+	JobId NextId();
 
 protected:
+	// fires the immediate jobs added before this call, false if destroyed meanwhile
+	bool PopImmediates(size_t& nExpires);
+	// turns an immediate job into a timed one with the same id and callback
+	bool RescheduleImmediate(JobId handle, TimeUnit expireTime);
+	// calls the batch sinks collected by PopExpires, false if destroyed meanwhile
+	bool FlushBatches();
+
 	template <class Tag, class Key>
 	inline JobSet::iterator Find(Key const& key) {
 		return boost::multi_index::get<Tag>(jobs_).find(key);
@@ -93,7 +155,23 @@ protected:
 protected:
 	JobId nextId_;
 	JobSet jobs_;
+	ImmediateJobSet immediates_;
+	TimeUnit immediateEpoch_;
+	// id of the immediate job whose callback is running, 0 if none
+	JobId firingImmediate_;
 	bool *destroyFlag_;
+	// expired ids per batch sink, kept across ticks to reuse their buffers.
+	// removed sinks leave a null slot until Compact
+	std::vector<std::pair<BatchExpireCallback*, std::vector<JobId>>> batches_;
+	// slot in batches_ of each sink
+	std::unordered_map<BatchExpireCallback*, size_t> batchSlots_;
+};
+
+// TreeJobContainer closed for extension, schedulers naming it as their
+// container type (see StaticScheduler) call it directly
+class StaticTreeJobContainer final : public TreeJobContainer {
+public:
+	using TreeJobContainer::TreeJobContainer;
 };
 
 } // namespace elapse
\ No newline at end of file
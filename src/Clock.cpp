@@ -27,7 +27,10 @@ OTHER DEALINGS IN THE SOFTWARE.
 For more information, please refer to <http://unlicense.org>
 */
 #include "Clock.hpp"
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <limits>
 #ifdef DEBUG_PRINT
 #include <iostream>
 #endif
@@ -36,11 +39,11 @@ For more information, please refer to <http://unlicense.org>
 namespace elapse {
 
 TimeUnit ToTimeUnit(std::time_t tm) {
-	return tm * 1000;
+	return static_cast<TimeUnit>(tm) * kTimeUnitsPerSecond;
 }
 
 TimeUnit Clock::Now() const {
-	return std::chrono::duration_cast<std::chrono::milliseconds>(TimePoint().time_since_epoch()).count();
+	return std::chrono::duration_cast<TimeUnitDuration>(TimePoint().time_since_epoch()).count();
 }
 
 std::time_t Clock::NowTimeT() const {
@@ -48,31 +51,19 @@ std::time_t Clock::NowTimeT() const {
 }
 
 Clock::time_point Clock::TimePoint() const {
-	return clock_source::now() + std::chrono::milliseconds(offsetInMillis_);
+	return clock_source::now() + std::chrono::duration_cast<clock_source::duration>(TimeUnitDuration(offset_));
 }
 
 void Clock::Advance(TimeOffset delta) {
 #ifdef DEBUG_PRINT
 	auto before = Now();
 #endif
-	offsetInMillis_ += delta;
+	offset_ += delta;
 #ifdef DEBUG_PRINT
 	std::cout << "  clock adjust " << before << " -> " << Now() << std::endl;
 #endif
 }
 
-TimeUnit LazyClock::Now() const {
-	return lazyNow_;
-}
-
-std::time_t LazyClock::NowTimeT() const {
-	return lazyTimeT_;
-}
-
-LazyClock::time_point LazyClock::TimePoint() const {
-	return lazyTimePoint_;
-}
-
 void LazyClock::Advance(TimeOffset delta) {
 	Clock::Advance(delta);
 	Refresh();
@@ -84,4 +75,76 @@ void LazyClock::Refresh() {
 	lazyTimeT_ = Clock::NowTimeT();
 }
 
+DomainClock::DomainClock(std::shared_ptr<Clock> base, double rate) :
+	base_(base),
+	baseAnchor_(base->Now()),
+	domainAnchor_(baseAnchor_),
+	rate_(rate > 0 ? rate : 0.0),
+	paused_(false) {
+}
+
+TimeUnit DomainClock::Now() const {
+	if (paused_) {
+		return domainAnchor_;
+	}
+	auto baseNow = base_->Now();
+	if (baseNow <= baseAnchor_) {
+		return domainAnchor_;
+	}
+	return domainAnchor_ + static_cast<TimeUnit>((baseNow - baseAnchor_) * rate_);
+}
+
+std::time_t DomainClock::NowTimeT() const {
+	return std::chrono::system_clock::to_time_t(TimePoint());
+}
+
+DomainClock::time_point DomainClock::TimePoint() const {
+	return time_point(std::chrono::duration_cast<clock_source::duration>(TimeUnitDuration(Now())));
+}
+
+void DomainClock::Advance(TimeOffset delta) {
+	Rebase();
+	domainAnchor_ += delta;
+}
+
+TimeUnit DomainClock::ToBaseTime(TimeUnit t) const {
+	auto now = Now();
+	auto baseNow = base_->Now();
+	if (t <= now) {
+		return baseNow;
+	}
+	if (paused_ || rate_ <= 0) {
+		return std::numeric_limits<TimeUnit>::max();
+	}
+	auto baseAnchor = std::max(baseNow, baseAnchor_);
+	return baseAnchor + static_cast<TimeUnit>(std::ceil((t - now) / rate_));
+}
+
+void DomainClock::Pause() {
+	if (paused_) {
+		return;
+	}
+	Rebase();
+	paused_ = true;
+}
+
+void DomainClock::Resume() {
+	if (!paused_) {
+		return;
+	}
+	baseAnchor_ = base_->Now();
+	paused_ = false;
+}
+
+void DomainClock::SetRate(double rate) {
+	Rebase();
+	// domain time never runs backwards
+	rate_ = rate > 0 ? rate : 0.0;
+}
+
+void DomainClock::Rebase() {
+	domainAnchor_ = Now();
+	baseAnchor_ = std::max(baseAnchor_, base_->Now());
+}
+
 } // namespace elapse
\ No newline at end of file
@@ -0,0 +1,347 @@
+/*
+Author: ywx217@gmail.com
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#include "CronSpecSet.hpp"
+#include <algorithm>
+#include "Clock.hpp"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+namespace elapse {
+namespace crontab {
+
+namespace {
+
+const std::uint32_t kNoTime = ~std::uint32_t(0);
+// days looked ahead in bulk before the remaining specs are searched one by one
+const std::size_t kLookaheadDays = 366;
+// positions of the month and day of week masks in a calendar word
+const unsigned kMonthShift = 31;
+const unsigned kWeekDayShift = kMonthShift + 12;
+
+inline int LowestBit(std::uint64_t word) {
+#if defined(__GNUC__)
+	return __builtin_ctzll(word);
+#else
+	int n = 0;
+	for (; !(word & 1); word >>= 1) {
+		++n;
+	}
+	return n;
+#endif
+}
+
+inline std::size_t PopCount(std::uint64_t word) {
+#if defined(__GNUC__)
+	return __builtin_popcountll(word);
+#else
+	std::size_t n = 0;
+	for (; word; word &= word - 1) {
+		++n;
+	}
+	return n;
+#endif
+}
+
+// bits of `word` at `from` and above
+inline std::uint64_t BitsFrom(std::uint64_t word, std::size_t from) {
+	return from >= 64 ? 0 : word & (~std::uint64_t(0) << from);
+}
+
+// earliest second of the day at or after hour:minute:second, kNoTime if none left
+inline std::uint32_t TimeOfDay(std::uint64_t hours, std::uint64_t minutes, std::uint64_t seconds,
+			std::size_t hour, std::size_t minute, std::size_t second) {
+	bool hourFits = (hours >> hour) & 1;
+	if (hourFits && ((minutes >> minute) & 1)) {
+		if (auto s = BitsFrom(seconds, second)) {
+			return static_cast<std::uint32_t>(hour * 3600 + minute * 60 + LowestBit(s));
+		}
+	}
+	if (!minutes || !seconds) {
+		return kNoTime;
+	}
+	if (hourFits) {
+		if (auto m = BitsFrom(minutes, minute + 1)) {
+			return static_cast<std::uint32_t>(hour * 3600 + LowestBit(m) * 60 + LowestBit(seconds));
+		}
+	}
+	if (auto h = BitsFrom(hours, hour + 1)) {
+		return static_cast<std::uint32_t>(LowestBit(h) * 3600 + LowestBit(minutes) * 60 + LowestBit(seconds));
+	}
+	return kNoTime;
+}
+
+std::time_t LocalMidnight(std::size_t year, std::size_t month, std::size_t day) {
+	std::tm tm = {};
+	tm.tm_year = static_cast<int>(year) - 1900;
+	tm.tm_mon = static_cast<int>(month) - 1;
+	tm.tm_mday = static_cast<int>(day);
+	tm.tm_isdst = -1;
+	return std::mktime(&tm);
+}
+
+// steps a date to the following day
+void Following(std::size_t& year, std::size_t& month, std::size_t& day) {
+	if (++day > DaysInMonth(year, month)) {
+		day = 1;
+		if (++month > 12) {
+			month = 1;
+			++year;
+		}
+	}
+}
+
+} // namespace
+
+// one calendar day shared by all specs of an evaluation
+struct CronSpecSet::Day {
+	Day(std::size_t year, std::size_t month, std::size_t day) :
+		year_(year), month_(month), day_(day),
+		weekDay_(WeekDay(year, month, day)),
+		midnight_(LocalMidnight(year, month, day)) {
+		Following(year, month, day);
+		nextMidnight_ = LocalMidnight(year, month, day);
+	}
+
+	void Next() {
+		Following(year_, month_, day_);
+		weekDay_ = (weekDay_ + 1) % 7;
+		midnight_ = nextMidnight_;
+		std::size_t year = year_, month = month_, day = day_;
+		Following(year, month, day);
+		nextMidnight_ = LocalMidnight(year, month, day);
+	}
+
+	// local time is midnight plus seconds of the day, no dst shift inside
+	bool Uniform() const { return midnight_ != -1 && nextMidnight_ - midnight_ == 86400; }
+	// the calendar word bits a spec needs to fire on this day
+	std::uint64_t Mask() const {
+		return (std::uint64_t(1) << (day_ - 1)) | (std::uint64_t(1) << (kMonthShift + month_ - 1)) |
+			(std::uint64_t(1) << (kWeekDayShift + weekDay_));
+	}
+
+	std::size_t year_, month_, day_;
+	int weekDay_;
+	std::time_t midnight_, nextMidnight_;
+};
+
+std::size_t CronSpecSet::Add(CronSpec const& spec) {
+	std::size_t idx = Size();
+	second_.push_back(0);
+	minute_.push_back(0);
+	hour_.push_back(0);
+	calendar_.push_back(0);
+	for (auto& year : year_) {
+		year.push_back(0);
+	}
+	if (idx % 64 == 0) {
+		feasible_.push_back(0);
+	}
+	Set(idx, spec);
+	return idx;
+}
+
+void CronSpecSet::Set(std::size_t idx, CronSpec const& spec) {
+	second_[idx] = spec.Second().Word(0);
+	minute_[idx] = spec.Minute().Word(0);
+	hour_[idx] = spec.Hour().Word(0);
+	calendar_[idx] = std::uint64_t(spec.DayOfMonth().Word(0)) | (std::uint64_t(spec.Month().Word(0)) << kMonthShift) |
+		(std::uint64_t(spec.DayOfWeek().Word(0)) << kWeekDayShift);
+	for (std::size_t i = 0; i < YearField::kWords; ++i) {
+		year_[i][idx] = spec.Year().Word(i);
+	}
+	auto bit = std::uint64_t(1) << (idx % 64);
+	feasible_[idx / 64] = spec.Feasible() ? feasible_[idx / 64] | bit : feasible_[idx / 64] & ~bit;
+}
+
+CronSpec CronSpecSet::Get(std::size_t idx) const {
+	CronSpec spec;
+	spec.Second().SetWord(0, second_[idx]);
+	spec.Minute().SetWord(0, minute_[idx]);
+	spec.Hour().SetWord(0, hour_[idx]);
+	auto calendar = calendar_[idx];
+	spec.DayOfMonth().SetWord(0, static_cast<DayOfMonthField::word_type>(calendar & ((std::uint64_t(1) << kMonthShift) - 1)));
+	spec.Month().SetWord(0, static_cast<MonthField::word_type>((calendar >> kMonthShift) & 0xfff));
+	spec.DayOfWeek().SetWord(0, static_cast<DayOfWeekField::word_type>(calendar >> kWeekDayShift));
+	for (std::size_t i = 0; i < YearField::kWords; ++i) {
+		spec.Year().SetWord(i, year_[i][idx]);
+	}
+	return spec;
+}
+
+void CronSpecSet::Reserve(std::size_t size) {
+	second_.reserve(size);
+	minute_.reserve(size);
+	hour_.reserve(size);
+	calendar_.reserve(size);
+	for (auto& year : year_) {
+		year.reserve(size);
+	}
+	feasible_.reserve((size + 63) / 64);
+}
+
+void CronSpecSet::Clear() {
+	second_.clear();
+	minute_.clear();
+	hour_.clear();
+	calendar_.clear();
+	for (auto& year : year_) {
+		year.clear();
+	}
+	feasible_.clear();
+}
+
+void CronSpecSet::FindNext(std::time_t now, std::vector<std::time_t>& next) const {
+	next.assign(Size(), 0);
+	std::time_t start = now + 1;
+	auto p = std::localtime(&start);
+	if (next.empty() || !p) {
+		return;
+	}
+	std::size_t year = p->tm_year + 1900, month = p->tm_mon + 1, dayOfMonth = p->tm_mday;
+	std::size_t hour = p->tm_hour, minute = p->tm_min, second = p->tm_sec;
+	if (year > 2099) {
+		return;
+	}
+	if (year < 1970) {
+		for (std::size_t i = 0; i < next.size(); ++i) {
+			Fallback(i, now, next[i]);
+		}
+		return;
+	}
+
+	// the first day starts at the reference time of day
+	Day day(year, month, dayOfMonth);
+	auto resolve = [this, &day, &next, now](std::size_t i, std::uint32_t tod) {
+		if (day.Uniform()) {
+			next[i] = day.midnight_ + tod;
+		} else {
+			Fallback(i, now, next[i]);
+		}
+	};
+	// specs left to resolve, never firing ones would otherwise walk the whole lookahead
+	std::vector<std::uint64_t> pending(feasible_), fits(feasible_.size());
+	std::size_t nPending = 0;
+	FitDay(day, 0, fits.size(), fits);
+	for (std::size_t w = 0; w < fits.size(); ++w) {
+		for (auto bits = fits[w]; bits; bits &= bits - 1) {
+			auto bit = LowestBit(bits);
+			auto i = w * 64 + bit;
+			auto tod = TimeOfDay(hour_[i], minute_[i], second_[i], hour, minute, second);
+			if (tod != kNoTime) {
+				resolve(i, tod);
+				pending[w] &= ~(std::uint64_t(1) << bit);
+			}
+		}
+		nPending += PopCount(pending[w]);
+	}
+
+	// following days start at midnight, only the words holding pending specs are tested
+	std::size_t begin = 0, end = pending.size();
+	for (std::size_t n = 0; n < kLookaheadDays && nPending; ++n) {
+		day.Next();
+		if (day.year_ > 2099) {
+			// past the year field, nothing fires anymore
+			nPending = 0;
+			break;
+		}
+		for (; !pending[begin]; ++begin) {}
+		for (; !pending[end - 1]; --end) {}
+		FitDay(day, begin, end, fits);
+		for (std::size_t w = begin; w < end; ++w) {
+			for (auto bits = fits[w] & pending[w]; bits; bits &= bits - 1) {
+				auto bit = LowestBit(bits);
+				auto i = w * 64 + bit;
+				auto tod = TimeOfDay(hour_[i], minute_[i], second_[i], 0, 0, 0);
+				if (tod != kNoTime) {
+					resolve(i, tod);
+					pending[w] &= ~(std::uint64_t(1) << bit);
+					--nPending;
+				}
+			}
+		}
+	}
+	for (std::size_t w = 0; w < pending.size() && nPending; ++w) {
+		for (auto bits = pending[w]; bits; bits &= bits - 1) {
+			auto i = w * 64 + LowestBit(bits);
+			Fallback(i, now, next[i]);
+		}
+	}
+}
+
+void CronSpecSet::NextExpire(Clock const& clock, std::vector<TimeUnit>& next) const {
+	std::vector<std::time_t> timestamps;
+	FindNext(clock.NowTimeT(), timestamps);
+	next.resize(timestamps.size());
+	for (std::size_t i = 0; i < timestamps.size(); ++i) {
+		next[i] = timestamps[i] ? ToTimeUnit(timestamps[i]) : 0;
+	}
+}
+
+void CronSpecSet::FitDay(Day const& day, std::size_t begin, std::size_t end, std::vector<std::uint64_t>& fits) const {
+	// one flat pass per day: a spec fits if its calendar word holds all the
+	// bits of the day and its year word the bit of the year
+	auto const* calendar = calendar_.data();
+	auto const* year = year_[(day.year_ - 1970) / 64].data();
+	auto mask = day.Mask();
+	unsigned yearBit = (day.year_ - 1970) % 64;
+	auto size = Size();
+#if defined(__SSE2__)
+	auto masks = _mm_set1_epi64x(static_cast<long long>(mask));
+	// moves the year bit up to the sign bit read by movemask
+	auto yearShift = _mm_cvtsi32_si128(static_cast<int>(63 - yearBit));
+#endif
+	for (std::size_t w = begin; w < end; ++w) {
+		std::size_t i = w * 64, last = std::min(i + 64, size);
+		std::uint64_t bits = 0;
+#if defined(__SSE2__)
+		// two specs per step, sse2 has no 64-bit compare so both 32-bit halves must match
+		for (; i + 2 <= last; i += 2) {
+			auto words = _mm_loadu_si128(reinterpret_cast<__m128i const*>(calendar + i));
+			auto match = _mm_cmpeq_epi32(_mm_and_si128(words, masks), masks);
+			match = _mm_and_si128(match, _mm_shuffle_epi32(match, _MM_SHUFFLE(2, 3, 0, 1)));
+			match = _mm_and_si128(match, _mm_sll_epi64(_mm_loadu_si128(reinterpret_cast<__m128i const*>(year + i)), yearShift));
+			bits |= static_cast<std::uint64_t>(_mm_movemask_pd(_mm_castsi128_pd(match))) << (i % 64);
+		}
+#endif
+		for (; i < last; ++i) {
+			bits |= static_cast<std::uint64_t>(((calendar[i] & mask) == mask) & (year[i] >> yearBit) & 1) << (i % 64);
+		}
+		fits[w] = bits;
+	}
+}
+
+void CronSpecSet::Fallback(std::size_t idx, std::time_t now, std::time_t& next) const {
+	std::time_t t = now;
+	next = Get(idx).FindNext(t) ? t : 0;
+}
+
+} // namespace crontab
+} // namespace elapse
\ No newline at end of file
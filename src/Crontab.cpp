@@ -34,15 +34,28 @@ For more information, please refer to <http://unlicense.org>
 namespace elapse {
 namespace crontab {
 
-inline void TimeNormalize(std::tm& tm) {
-	auto t = std::mktime(&tm);
-	auto p = std::localtime(&t);
-	if (p) {
-		tm = *p;
+namespace {
+
+// earliest fitting time of day at or after hour:minute:second
+bool NextTimeOfDay(CronSpec const& spec, std::size_t& hour, std::size_t& minute, std::size_t& second) {
+	for (std::size_t h = hour; spec.Hour().FirstFit(h, h); ++h) {
+		std::size_t m = h == hour ? minute : 0;
+		for (; spec.Minute().FirstFit(m, m); ++m) {
+			std::size_t s = (h == hour && m == minute) ? second : 0;
+			if (spec.Second().FirstFit(s, s)) {
+				hour = h;
+				minute = m;
+				second = s;
+				return true;
+			}
+		}
 	}
+	return false;
 }
 
-TimeUnit Crontab::NextExpire(Clock const& clock) {
+} // namespace
+
+TimeUnit CronSpec::NextExpire(Clock const& clock) const {
 	auto expire = clock.NowTimeT();
 	if (!FindNext(expire, 1)) {
 		return 0;
@@ -50,163 +63,251 @@ TimeUnit Crontab::NextExpire(Clock const& clock) {
 	return ToTimeUnit(expire);
 }
 
-bool Crontab::FindNext(std::time_t& timestamp, int offset) const {
-	std::tm now;
-	timestamp += offset;
-	auto p = std::localtime(&timestamp);
+bool CronSpec::FindNext(std::time_t& timestamp, int offset) const {
+	std::time_t start = timestamp + offset;
+	if (!Feasible()) {
+		return false;
+	}
+	auto p = std::localtime(&start);
 	if (!p) {
 		return false;
 	}
-	now = *p;
+	std::size_t year = p->tm_year + 1900, month = p->tm_mon + 1, day = p->tm_mday;
+	std::size_t hour = p->tm_hour, minute = p->tm_min, second = p->tm_sec;
+	int startDst = p->tm_isdst;
+	auto startOfDay = [&]() { hour = minute = second = 0; };
 
-	int next;
+	// steps whole years, months and days without calling into libc, the
+	// search ends with the last year of the field
+	std::size_t next = 0;
 	while (true) {
-		// second
-		if (!second_.NextFit(now.tm_sec, next)) {
+		if (!year_.FirstFit(year, next)) {
 			return false;
 		}
-		if (now.tm_sec > next) {
-			now.tm_sec = next;
-			++now.tm_min;
-			TimeNormalize(now);
-		} else {
-			now.tm_sec = next;
-		}
-		// minute
-		if (!minute_.NextFit(now.tm_min, next)) {
-			return false;
+		if (next != year) {
+			year = next;
+			month = day = 1;
+			startOfDay();
 		}
-		if (now.tm_min != next) {
-			if (now.tm_min > next) {
-				++now.tm_hour;
-				TimeNormalize(now);
-			}
-			now.tm_min = next;
-			now.tm_sec = 0;
+		if (!month_.FirstFit(month, next)) {
+			++year;
+			month = day = 1;
+			startOfDay();
 			continue;
 		}
-		// hour
-		if (!hour_.NextFit(now.tm_hour, next)) {
-			return false;
+		if (next != month) {
+			month = next;
+			day = 1;
+			startOfDay();
 		}
-		if (now.tm_hour != next) {
-			if (now.tm_hour > next) {
-				++now.tm_mday;
-				TimeNormalize(now);
-			}
-			now.tm_hour = next;
-			now.tm_min = 0;
-			now.tm_sec = 0;
+		if (!dom_.FirstFit(day, next) || next > DaysInMonth(year, month)) {
+			++month;
+			day = 1;
+			startOfDay();
 			continue;
 		}
-		// day (including dow and dom)
-		if (!dow_.NextFit(now.tm_wday, next)) {
-			return false;
+		if (next != day) {
+			day = next;
+			startOfDay();
 		}
-		if (now.tm_wday != next) {
-			int deltaDays = next - now.tm_wday;
-			if (deltaDays < 0) {
-				deltaDays += 7;
-			}
-			now.tm_mday += deltaDays;
-			now.tm_hour = 0;
-			now.tm_min = 0;
-			now.tm_sec = 0;
-			TimeNormalize(now);
+		if (!dow_.Fits(WeekDay(year, month, day)) || !NextTimeOfDay(*this, hour, minute, second)) {
+			++day;
+			startOfDay();
 			continue;
 		}
-		if (!dom_.NextFit(now.tm_mday, next)) {
-			return false;
+		break;
+	}
+
+	int isDst = -1;
+	auto toTime = [&](int dst) {
+		std::tm tm = {};
+		tm.tm_year = static_cast<int>(year) - 1900;
+		tm.tm_mon = static_cast<int>(month) - 1;
+		tm.tm_mday = static_cast<int>(day);
+		tm.tm_hour = static_cast<int>(hour);
+		tm.tm_min = static_cast<int>(minute);
+		tm.tm_sec = static_cast<int>(second);
+		tm.tm_isdst = dst;
+		auto t = std::mktime(&tm);
+		isDst = tm.tm_isdst;
+		return t;
+	};
+	auto result = toTime(-1);
+	if (result != -1 && startDst > 0 && isDst == 0) {
+		// a local time repeated by a dst fall back fires at its first occurrence after start
+		std::time_t first = result - 3600;
+		auto q = first >= start ? std::localtime(&first) : nullptr;
+		if (q && q->tm_isdst > 0 && q->tm_mday == static_cast<int>(day) && q->tm_hour == static_cast<int>(hour)
+			&& q->tm_min == static_cast<int>(minute) && q->tm_sec == static_cast<int>(second)) {
+			result = first;
 		}
-		if (now.tm_mday != next) {
-			if (now.tm_mday > next) {
-				++now.tm_mon;
-			}
-			now.tm_mday = next;
-			now.tm_hour = 0;
-			now.tm_min = 0;
-			now.tm_sec = 0;
-			TimeNormalize(now);
+	}
+	if (result == -1) {
+		return false;
+	}
+	timestamp = result;
+	return true;
+}
+
+std::size_t CronSpec::Hash() const {
+	std::size_t seed = 0;
+	auto combine = [&seed](std::uint64_t word) {
+		seed ^= std::hash<std::uint64_t>()(word) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+	};
+	for (std::size_t i = 0; i < YearField::kWords; ++i) {
+		combine(year_.Word(i));
+	}
+	combine(second_.Word(0));
+	combine(minute_.Word(0));
+	combine((static_cast<std::uint64_t>(hour_.Word(0)) << 32) | dom_.Word(0));
+	combine((static_cast<std::uint64_t>(month_.Word(0)) << 8) | dow_.Word(0));
+	return seed;
+}
+
+
+namespace {
+
+const std::int64_t kDaySeconds = 86400;
+// the utc offset is probed weekly over the next 400 days, no zone switches twice within a week
+const std::int64_t kProbeStep = 7 * kDaySeconds;
+const std::int64_t kHorizon = 400 * kDaySeconds;
+
+// days since 1970-01-01 of a gregorian date
+std::int64_t DaysFromCivil(std::int64_t year, std::int64_t month, std::int64_t day) {
+	year -= month <= 2;
+	std::int64_t era = (year >= 0 ? year : year - 399) / 400;
+	std::int64_t yoe = year - era * 400;
+	std::int64_t doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+	std::int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
+
+// gregorian year of a day since 1970-01-01
+std::int64_t YearFromDays(std::int64_t days) {
+	days += 719468;
+	std::int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+	std::int64_t doe = days - era * 146097;
+	std::int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	std::int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	// the shifted year starts in march
+	return yoe + era * 400 + (doy >= 306 ? 1 : 0);
+}
+
+// local minus utc seconds at `t`
+bool UtcOffset(std::time_t t, std::int64_t& offset) {
+	auto p = std::localtime(&t);
+	if (!p) {
+		return false;
+	}
+	std::int64_t local = DaysFromCivil(p->tm_year + 1900, p->tm_mon + 1, p->tm_mday) * kDaySeconds
+		+ p->tm_hour * 3600 + p->tm_min * 60 + p->tm_sec;
+	offset = local - t;
+	return true;
+}
+
+bool ValidTime(std::size_t hour, std::size_t minute, std::size_t second) {
+	return hour < 24 && minute < 60 && second < 60;
+}
+
+} // namespace
+
+std::time_t LocalCalendar::NextDaily(std::time_t now, std::size_t hour, std::size_t minute, std::size_t second) {
+	std::int64_t local = 0;
+	if (!ValidTime(hour, minute, second) || !Local(now, local)) {
+		return 0;
+	}
+	std::int64_t tod = hour * 3600 + minute * 60 + second;
+	std::int64_t day = local / kDaySeconds;
+	if (tod <= local % kDaySeconds) {
+		++day;
+	}
+	return ToUtc(day * kDaySeconds + tod);
+}
+
+std::time_t LocalCalendar::NextWeekly(std::time_t now, std::size_t week, std::size_t hour, std::size_t minute, std::size_t second) {
+	std::int64_t local = 0;
+	if (week > 7 || !ValidTime(hour, minute, second) || !Local(now, local)) {
+		return 0;
+	}
+	std::int64_t tod = hour * 3600 + minute * 60 + second;
+	std::int64_t day = local / kDaySeconds;
+	// 1970-01-01 was a thursday
+	std::int64_t ahead = (static_cast<std::int64_t>(week % 7) - (day + 4) % 7 + 7) % 7;
+	if (ahead == 0 && tod <= local % kDaySeconds) {
+		ahead = 7;
+	}
+	return ToUtc((day + ahead) * kDaySeconds + tod);
+}
+
+std::time_t LocalCalendar::NextDate(std::time_t now, std::size_t month, std::size_t date,
+			std::size_t hour, std::size_t minute, std::size_t second) {
+	std::int64_t local = 0;
+	if (month < 1 || month > 12 || date < 1 || !ValidTime(hour, minute, second) || !Local(now, local)) {
+		return 0;
+	}
+	std::int64_t tod = hour * 3600 + minute * 60 + second;
+	std::int64_t today = local / kDaySeconds;
+	auto year = static_cast<std::size_t>(YearFromDays(today));
+	for (int i = 0; i < 2; ++i, ++year) {
+		// leap days further away are left to the full search
+		if (date > DaysInMonth(year, month)) {
 			continue;
 		}
-		// month
-		if (!month_.NextFit(now.tm_mon + 1, next)) {
+		std::int64_t day = DaysFromCivil(year, month, date);
+		if (day > today || (day == today && tod > local % kDaySeconds)) {
+			return ToUtc(day * kDaySeconds + tod);
+		}
+	}
+	return 0;
+}
+
+bool LocalCalendar::Local(std::time_t now, std::int64_t& local) {
+	if ((now < from_ || now >= until_) && !Refresh(now)) {
+		return false;
+	}
+	local = now + offset_;
+	return local >= 0;
+}
+
+std::time_t LocalCalendar::ToUtc(std::int64_t local) const {
+	std::int64_t t = local - offset_;
+	return t >= from_ && t < until_ ? static_cast<std::time_t>(t) : 0;
+}
+
+bool LocalCalendar::Refresh(std::time_t now) {
+	Invalidate();
+	if (!UtcOffset(now, offset_)) {
+		return false;
+	}
+	std::time_t until = now + kHorizon;
+	std::int64_t offset = 0;
+	for (std::time_t probe = now + kProbeStep; probe <= now + kHorizon; probe += kProbeStep) {
+		if (!UtcOffset(probe, offset)) {
 			return false;
 		}
-		if (now.tm_mon != next - 1) {
-			if (now.tm_mon > next - 1) {
-				++now.tm_year;
-			}
-			now.tm_mon = next - 1;
-			now.tm_mday = 1;
-			now.tm_hour = 0;
-			now.tm_min = 0;
-			now.tm_sec = 0;
-			TimeNormalize(now);
+		if (offset == offset_) {
 			continue;
 		}
-		// year
-		if (!year_.NextFit(now.tm_year + 1900, next)) {
-			return false;
-		}
-		if (now.tm_year + 1900 != next) {
-			return false;
+		// first second of the new offset
+		std::time_t lo = probe - kProbeStep, hi = probe;
+		while (hi - lo > 1) {
+			auto mid = lo + (hi - lo) / 2;
+			if (!UtcOffset(mid, offset)) {
+				return false;
+			}
+			(offset == offset_ ? lo : hi) = mid;
 		}
+		until = hi;
 		break;
 	}
-
-	timestamp = std::mktime(&now);
+	from_ = now;
+	until_ = until;
 	return true;
 }
 
-void Crontab::Parse(size_t hour, size_t minute, size_t second) {
-	year_.SetFitsAll();
-	month_.SetFitsAll();
-	dom_.SetFitsAll();
-	dow_.SetFitsAll();
-	hour_.SetSingle(hour);
-	minute_.SetSingle(minute);
-	second_.SetSingle(second);
-}
-
-void Crontab::Parse(size_t week, size_t hour, size_t minute, size_t second) {
-	year_.SetFitsAll();
-	month_.SetFitsAll();
-	dom_.SetFitsAll();
-	dow_.SetSingle(week == 7 ? 0 : week);
-	hour_.SetSingle(hour);
-	minute_.SetSingle(minute);
-	second_.SetSingle(second);
-}
-
-void Crontab::Parse(size_t month, size_t date, size_t hour, size_t minute, size_t second) {
-	year_.SetFitsAll();
-	month_.SetSingle(month);
-	dom_.SetSingle(date);
-	dow_.SetFitsAll();
-	hour_.SetSingle(hour);
-	minute_.SetSingle(minute);
-	second_.SetSingle(second);
-}
-
-void Crontab::ClearAll() {
-	year_.Clear();
-	month_.Clear();
-	dom_.Clear();
-	dow_.Clear();
-	hour_.Clear();
-	minute_.Clear();
-	second_.Clear();
-}
-
-void Crontab::SetAll() {
-	year_.SetFitsAll();
-	month_.SetFitsAll();
-	dom_.SetFitsAll();
-	dow_.SetFitsAll();
-	hour_.SetFitsAll();
-	minute_.SetFitsAll();
-	second_.SetFitsAll();
+
+TimeUnit Crontab::NextExpire(Clock const& clock) {
+	return CronSpec::NextExpire(clock);
 }
 
 
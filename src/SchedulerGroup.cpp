@@ -0,0 +1,134 @@
+/*
+Author: ywx217@gmail.com
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#include "SchedulerGroup.hpp"
+#include <algorithm>
+
+
+namespace elapse {
+
+const TimeUnit SchedulerGroup::NoDeadline;
+
+SchedulerBase::~SchedulerBase() {
+	if (group_) {
+		group_->Remove(*this);
+	}
+}
+
+void SchedulerBase::RefreshDeadline() {
+	if (group_) {
+		auto deadline = NextDeadline();
+		group_->Update(*this, deadline ? deadline : SchedulerGroup::NoDeadline);
+	}
+}
+
+void SchedulerBase::OnScheduled(TimeUnit deadline) {
+	if (group_) {
+		group_->Lower(*this, deadline);
+	}
+}
+
+SchedulerGroup::~SchedulerGroup() {
+	for (auto const& entry : heap_) {
+		entry.member->group_ = nullptr;
+	}
+	if (destroyFlag_) {
+		*destroyFlag_ = true;
+		destroyFlag_ = nullptr;
+	}
+}
+
+void SchedulerGroup::Add(SchedulerBase& member) {
+	if (member.group_ == this) {
+		return;
+	}
+	if (member.group_) {
+		member.group_->Remove(member);
+	}
+	auto deadline = member.NextDeadline();
+	member.groupHandle_ = heap_.push(detail::GroupEntry{deadline ? deadline : NoDeadline, &member});
+	member.group_ = this;
+}
+
+bool SchedulerGroup::Remove(SchedulerBase& member) {
+	if (member.group_ != this) {
+		return false;
+	}
+	heap_.erase(member.groupHandle_);
+	member.group_ = nullptr;
+	std::replace(due_.begin(), due_.end(), &member, static_cast<SchedulerBase*>(nullptr));
+	return true;
+}
+
+size_t SchedulerGroup::Tick() {
+	auto now = clock_->Now();
+	due_.clear();
+	while (!heap_.empty() && heap_.top().deadline <= now) {
+		auto member = heap_.top().member;
+		heap_.update(member->groupHandle_, detail::GroupEntry{NoDeadline, member});
+		due_.push_back(member);
+	}
+
+	size_t nTicked = 0;
+	bool destroyWhenTicking = false;
+	destroyFlag_ = &destroyWhenTicking;
+	for (size_t i = 0; i < due_.size(); ++i) {
+		if (!due_[i]) {
+			continue;
+		}
+		due_[i]->Tick();
+		++nTicked;
+		if (destroyWhenTicking) {
+			return nTicked;
+		}
+		// the member may have left the group from its own callbacks
+		if (due_[i]) {
+			auto deadline = due_[i]->NextDeadline();
+			Update(*due_[i], deadline ? deadline : NoDeadline);
+		}
+	}
+	destroyFlag_ = nullptr;
+	due_.clear();
+	return nTicked;
+}
+
+TimeUnit SchedulerGroup::NextDeadline() const {
+	return heap_.empty() ? NoDeadline : heap_.top().deadline;
+}
+
+void SchedulerGroup::Update(SchedulerBase& member, TimeUnit deadline) {
+	heap_.update(member.groupHandle_, detail::GroupEntry{deadline, &member});
+}
+
+void SchedulerGroup::Lower(SchedulerBase& member, TimeUnit deadline) {
+	if (deadline < (*member.groupHandle_).deadline) {
+		heap_.update(member.groupHandle_, detail::GroupEntry{deadline, &member});
+	}
+}
+
+} // namespace elapse
\ No newline at end of file
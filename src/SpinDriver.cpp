@@ -0,0 +1,167 @@
+/*
+Author: ywx217@gmail.com
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#include "SpinDriver.hpp"
+#include <thread>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+namespace elapse {
+
+namespace {
+
+// samples kept for the latency report
+const size_t kMaxSamples = 4096;
+
+inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#endif
+}
+
+// the clock a scheduler's deadlines are on, the base of its domain if any
+inline Clock& DeadlineClock(Clock& clock) {
+	auto domain = dynamic_cast<DomainClock*>(&clock);
+	return domain ? *domain->Base() : clock;
+}
+
+} // namespace
+
+SpinDriver::SpinDriver(SchedulerBase& scheduler, Clock& clock) :
+	tick_([&scheduler]() { scheduler.Tick(); }),
+	nextDeadline_([&scheduler]() { return scheduler.NextDeadline(); }),
+	clock_(DeadlineClock(clock)),
+	spinWindow_(std::chrono::microseconds(200)),
+	maxSleep_(std::chrono::milliseconds(10)),
+	stopped_(false),
+	ticks_(0),
+	nextSample_(0) {
+}
+
+SpinDriver::SpinDriver(SchedulerGroup& group, Clock& clock) :
+	tick_([&group]() { group.Tick(); }),
+	nextDeadline_([&group]() {
+		auto deadline = group.NextDeadline();
+		return deadline == SchedulerGroup::NoDeadline ? 0 : deadline;
+	}),
+	clock_(clock),
+	spinWindow_(std::chrono::microseconds(200)),
+	maxSleep_(std::chrono::milliseconds(10)),
+	stopped_(false),
+	ticks_(0),
+	nextSample_(0) {
+}
+
+bool SpinDriver::RunOnce() {
+	clock_.Advance(0);
+	auto deadline = NextDeadline();
+	if (!deadline) {
+		std::this_thread::sleep_for(maxSleep_);
+		return false;
+	}
+	// Now() is truncated to the time unit, the wait is timed at full precision
+	auto now = clock_.TimePoint();
+	auto deadlineTime = Clock::time_point(std::chrono::duration_cast<Clock::clock_source::duration>(
+		TimeUnitDuration(deadline)));
+	std::uint64_t latency = 0;
+	if (deadlineTime > now) {
+		auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(deadlineTime - now);
+		auto target = steady_clock::now() + remaining;
+		if (remaining > spinWindow_) {
+			if (remaining - spinWindow_ > maxSleep_) {
+				std::this_thread::sleep_for(maxSleep_);
+				return false;
+			}
+			std::this_thread::sleep_until(target - spinWindow_);
+		}
+		steady_clock::time_point woken;
+		while ((woken = steady_clock::now()) < target) {
+			if (stopped_) {
+				return false;
+			}
+			CpuRelax();
+		}
+		latency = std::chrono::duration_cast<std::chrono::nanoseconds>(woken - target).count();
+		clock_.Advance(0);
+	} else {
+		// already due when looked at
+		latency = std::chrono::duration_cast<std::chrono::nanoseconds>(now - deadlineTime).count();
+	}
+	tick_();
+	++ticks_;
+	Record(latency);
+	return true;
+}
+
+void SpinDriver::Run() {
+	stopped_ = false;
+	while (!stopped_) {
+		RunOnce();
+	}
+}
+
+bool SpinDriver::PinCurrentThread(int cpu) {
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+	(void)cpu;
+	return false;
+#endif
+}
+
+LatencyStats SpinDriver::WakeupLatency() const {
+	auto samples = samples_;
+	return LatencyStats::From(samples);
+}
+
+void SpinDriver::ResetStats() {
+	ticks_ = 0;
+	samples_.clear();
+	nextSample_ = 0;
+}
+
+TimeUnit SpinDriver::NextDeadline() const {
+	return nextDeadline_();
+}
+
+void SpinDriver::Record(std::uint64_t latency) {
+	if (samples_.size() < kMaxSamples) {
+		samples_.push_back(latency);
+		return;
+	}
+	samples_[nextSample_] = latency;
+	nextSample_ = (nextSample_ + 1) % kMaxSamples;
+}
+
+} // namespace elapse
\ No newline at end of file
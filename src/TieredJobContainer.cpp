@@ -0,0 +1,200 @@
+/*
+Author: ywx217@gmail.com
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#include <algorithm>
+#include "TieredJobContainer.hpp"
+
+
+namespace elapse {
+
+void TieredJobContainer::Place(JobId id, TimeUnit expireTime) {
+	if (IsCold(expireTime)) {
+		hot_.MoveJob(id, cold_);
+	}
+}
+
+JobId TieredJobContainer::Add(TimeUnit expireTime, ECPtr&& cb, GroupTag group) {
+	if (!IsCold(expireTime)) {
+		return hot_.Add(expireTime, std::move(cb), group);
+	}
+	auto id = hot_.NextId();
+	cold_.Add(id, expireTime, std::move(cb), group);
+	return id;
+}
+
+JobId TieredJobContainer::AddBatched(TimeUnit expireTime, BatchExpireCallback* sink, GroupTag group) {
+	if (!IsCold(expireTime)) {
+		return hot_.AddBatched(expireTime, sink, group);
+	}
+	auto id = hot_.NextId();
+	cold_.AddBatched(id, expireTime, sink, group);
+	return id;
+}
+
+void TieredJobContainer::AddBatch(std::vector<BatchJob>& jobs) {
+	auto nCold = std::count_if(jobs.begin(), jobs.end(), [this](BatchJob const& job) { return IsCold(job.expire_); });
+	if (!nCold) {
+		hot_.AddBatch(jobs);
+		return;
+	}
+	// the hot jobs are still inserted in one sorted batch
+	std::vector<BatchJob> hot;
+	std::vector<size_t> slots;
+	hot.reserve(jobs.size() - nCold);
+	slots.reserve(jobs.size() - nCold);
+	for (size_t i = 0; i < jobs.size(); ++i) {
+		auto& job = jobs[i];
+		if (IsCold(job.expire_)) {
+			job.id_ = hot_.NextId();
+			cold_.Add(job.id_, job.expire_, std::move(job.cb_), job.group_);
+		} else {
+			hot.push_back(std::move(job));
+			slots.push_back(i);
+		}
+	}
+	hot_.AddBatch(hot);
+	for (size_t i = 0; i < hot.size(); ++i) {
+		jobs[slots[i]].id_ = hot[i].id_;
+	}
+}
+
+size_t TieredJobContainer::RemoveBatch(std::vector<JobId> const& handles) {
+	if (!cold_.Size()) {
+		return hot_.RemoveBatch(handles);
+	}
+	size_t nRemoved = 0;
+	for (auto handle : handles) {
+		nRemoved += Remove(handle);
+	}
+	return nRemoved;
+}
+
+bool TieredJobContainer::Reschedule(JobId handle, TimeUnit expireTime) {
+	if (hot_.Reschedule(handle, expireTime)) {
+		// a job moved cold from its own callback survives the PopExpires firing it
+		Place(handle, expireTime);
+		return true;
+	}
+	if (!cold_.Reschedule(handle, expireTime)) {
+		return false;
+	}
+	if (!IsCold(expireTime)) {
+		cold_.MoveJob(handle, hot_);
+	}
+	return true;
+}
+
+void TieredJobContainer::RemoveAll() {
+	hot_.RemoveAll();
+	cold_.RemoveAll();
+}
+
+void TieredJobContainer::Start(TimeUnit now) {
+	limit_ = now + horizon_;
+	cold_.MoveExpiring(limit_, hot_);
+	hot_.MoveExpiringFrom(limit_, cold_);
+}
+
+size_t TieredJobContainer::PopExpires(TimeUnit now) {
+	if (!limit_) {
+		Start(now);
+	} else if (now + horizon_ / 2 >= limit_) {
+		// promote the next window in one batch, also catching up after a time jump
+		limit_ = now + horizon_;
+		cold_.MoveExpiring(limit_, hot_);
+	}
+	return hot_.PopExpires(now);
+}
+
+void TieredJobContainer::IterJobs(JobPredicate pred) const {
+	bool stopped = false;
+	hot_.IterJobs([&pred, &stopped](Job const& job) {
+		stopped = !pred(job);
+		return !stopped;
+	});
+	if (!stopped) {
+		cold_.IterJobs(pred);
+	}
+}
+
+void TieredJobContainer::RemoveJobs(JobPredicate pred) {
+	hot_.RemoveJobs(pred);
+	cold_.RemoveJobs(pred);
+}
+
+size_t TieredJobContainer::RemoveJobsStep(RemoveCursor& cursor, JobPredicate pred, size_t budget) {
+	size_t nRemoved = 0;
+	if (cursor.tier_ == 0) {
+		auto visited = cursor.visited_;
+		nRemoved = hot_.RemoveJobsStep(cursor, pred, budget);
+		if (!cursor.Done()) {
+			return nRemoved;
+		}
+		// the cold tier next, with what is left of the budget. jobs promoted
+		// meanwhile are missed like any job moved behind the cursor
+		budget -= std::min(budget, cursor.visited_ - visited);
+		cursor.phase_ = RemoveCursor::kJobs;
+		cursor.tier_ = 1;
+		cursor.next_ = 0;
+		cursor.expire_ = 0;
+	}
+	if (cursor.tier_ == 1 && !cursor.Done() && budget) {
+		nRemoved += cold_.RemoveJobsStep(cursor, pred, budget);
+	}
+	return nRemoved;
+}
+
+void TieredJobContainer::IterGroup(GroupTag group, JobPredicate pred) const {
+	bool stopped = false;
+	hot_.IterGroup(group, [&pred, &stopped](Job const& job) {
+		stopped = !pred(job);
+		return !stopped;
+	});
+	if (!stopped) {
+		cold_.IterGroup(group, pred);
+	}
+}
+
+TimeUnit TieredJobContainer::EarliestExpire() const {
+	// cold jobs are all due after the hot ones
+	auto expireTime = hot_.EarliestExpire();
+	return expireTime ? expireTime : cold_.EarliestExpire();
+}
+
+MemoryUsage TieredJobContainer::Memory() const {
+	auto usage = hot_.Memory();
+	usage += cold_.Memory();
+	return usage;
+}
+
+void TieredJobContainer::Compact() {
+	hot_.Compact();
+	cold_.Compact();
+}
+
+} // namespace elapse
\ No newline at end of file
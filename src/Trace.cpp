@@ -0,0 +1,307 @@
+/*
+Author: ywx217@gmail.com
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#include "Trace.hpp"
+#include <algorithm>
+
+
+namespace elapse {
+
+namespace {
+
+const char kTraceMagic[8] = {'E', 'L', 'T', 'R', 'A', 'C', 'E', '1'};
+
+std::uint64_t ZigZag(std::int64_t value) {
+	return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+}
+
+std::int64_t UnZigZag(std::uint64_t value) {
+	return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+}
+
+bool HasId(TraceOp op) {
+	return op != TraceOp::RemoveAll && op != TraceOp::RemoveGroup && op != TraceOp::Tick && op != TraceOp::TickEnd;
+}
+
+bool HasExpire(TraceOp op) {
+	return op == TraceOp::Add || op == TraceOp::AddBatched || op == TraceOp::Reschedule;
+}
+
+bool HasGroup(TraceOp op) {
+	return op == TraceOp::Add || op == TraceOp::AddBatched || op == TraceOp::AddImmediate ||
+		op == TraceOp::RemoveGroup;
+}
+
+// fires its callback after logging it
+class ECRecordFire : public ExpireCallback {
+public:
+	ECRecordFire(std::shared_ptr<TraceWriter> const& writer, ECPtr&& cb) : writer_(writer), cb_(std::move(cb)) {}
+	virtual ~ECRecordFire() {}
+
+	virtual void operator()(JobId id) override {
+		writer_->Write(TraceOp::Fire, writer_->LastTime(), id);
+		(*cb_)(id);
+	}
+	virtual std::size_t Bytes() const override { return sizeof(*this) + cb_->Bytes(); }
+
+private:
+	std::shared_ptr<TraceWriter> writer_;
+	ECPtr cb_;
+};
+
+// logs the firing of batched jobs before handing them to the sink
+class RecordFireSink : public BatchExpireCallback {
+public:
+	RecordFireSink(std::shared_ptr<TraceWriter> const& writer, BatchExpireCallback* sink) : writer_(writer), sink_(sink) {}
+	virtual ~RecordFireSink() {}
+
+	virtual void operator()(JobId const* ids, size_t count) override {
+		for (size_t i = 0; i < count; ++i) {
+			writer_->Write(TraceOp::Fire, writer_->LastTime(), ids[i]);
+		}
+		(*sink_)(ids, count);
+	}
+
+private:
+	std::shared_ptr<TraceWriter> writer_;
+	BatchExpireCallback* sink_;
+};
+
+} // namespace
+
+TraceWriter::TraceWriter(std::ostream& os) : os_(os), lastTime_(0), count_(0) {
+	os_.write(kTraceMagic, sizeof(kTraceMagic));
+}
+
+void TraceWriter::Write(TraceOp op, TimeUnit time, JobId id, TimeUnit expire, GroupTag group) {
+	os_.put(static_cast<char>(op));
+	// clocks may step back, deltas are signed
+	WriteVarint(ZigZag(static_cast<std::int64_t>(time - lastTime_)));
+	lastTime_ = time;
+	if (HasId(op)) {
+		WriteVarint(id);
+	}
+	if (HasExpire(op)) {
+		WriteVarint(ZigZag(static_cast<std::int64_t>(expire - time)));
+	}
+	if (HasGroup(op)) {
+		WriteVarint(group);
+	}
+	++count_;
+}
+
+void TraceWriter::WriteVarint(std::uint64_t value) {
+	char buf[10];
+	size_t n = 0;
+	while (value >= 0x80) {
+		buf[n++] = static_cast<char>(value | 0x80);
+		value >>= 7;
+	}
+	buf[n++] = static_cast<char>(value);
+	os_.write(buf, n);
+}
+
+TraceReader::TraceReader(std::istream& is) : is_(is), lastTime_(0), valid_(false) {
+	char magic[sizeof(kTraceMagic)];
+	valid_ = static_cast<bool>(is_.read(magic, sizeof(magic))) &&
+		std::equal(magic, magic + sizeof(magic), kTraceMagic);
+}
+
+bool TraceReader::Next(TraceEvent& event) {
+	if (!valid_) {
+		return false;
+	}
+	auto op = is_.get();
+	if (op == std::istream::traits_type::eof() || op < static_cast<int>(TraceOp::Add) ||
+			op > static_cast<int>(TraceOp::TickEnd)) {
+		return false;
+	}
+	event = TraceEvent{static_cast<TraceOp>(op), 0, 0, 0, NullGroup};
+	std::uint64_t value;
+	if (!ReadVarint(value)) {
+		return false;
+	}
+	lastTime_ += UnZigZag(value);
+	event.time_ = lastTime_;
+	if (HasId(event.op_) && !ReadVarint(event.id_)) {
+		return false;
+	}
+	if (HasExpire(event.op_)) {
+		if (!ReadVarint(value)) {
+			return false;
+		}
+		event.expire_ = event.time_ + UnZigZag(value);
+	}
+	if (HasGroup(event.op_) && !ReadVarint(event.group_)) {
+		return false;
+	}
+	return true;
+}
+
+bool TraceReader::ReadVarint(std::uint64_t& value) {
+	value = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		auto c = is_.get();
+		if (c == std::istream::traits_type::eof()) {
+			return false;
+		}
+		value |= static_cast<std::uint64_t>(c & 0x7f) << shift;
+		if (!(c & 0x80)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+RecordingJobContainer::RecordingJobContainer(std::shared_ptr<JobContainer> inner, std::shared_ptr<TraceWriter> writer,
+			std::shared_ptr<Clock> clock) :
+	inner_(inner),
+	writer_(writer),
+	clock_(clock) {
+}
+
+JobId RecordingJobContainer::Add(TimeUnit expireTime, ECPtr&& cb) {
+	return Add(expireTime, std::move(cb), NullGroup);
+}
+
+JobId RecordingJobContainer::Add(TimeUnit expireTime, ECPtr&& cb, GroupTag group) {
+	auto id = inner_->Add(expireTime, Wrap(std::move(cb)), group);
+	writer_->Write(TraceOp::Add, Now(), id, expireTime, group);
+	return id;
+}
+
+JobId RecordingJobContainer::AddImmediate(ECPtr&& cb, GroupTag group) {
+	auto id = inner_->AddImmediate(Wrap(std::move(cb)), group);
+	writer_->Write(TraceOp::AddImmediate, Now(), id, 0, group);
+	return id;
+}
+
+JobId RecordingJobContainer::AddBatched(TimeUnit expireTime, BatchExpireCallback* sink, GroupTag group) {
+	auto id = inner_->AddBatched(expireTime, WrapSink(sink), group);
+	writer_->Write(TraceOp::AddBatched, Now(), id, expireTime, group);
+	return id;
+}
+
+void RecordingJobContainer::AddBatch(std::vector<BatchJob>& jobs) {
+	for (auto& job : jobs) {
+		job.cb_ = Wrap(std::move(job.cb_));
+	}
+	inner_->AddBatch(jobs);
+	auto now = Now();
+	for (auto const& job : jobs) {
+		writer_->Write(TraceOp::Add, now, job.id_, job.expire_, job.group_);
+	}
+}
+
+bool RecordingJobContainer::Remove(JobId handle) {
+	writer_->Write(TraceOp::Remove, Now(), handle);
+	return inner_->Remove(handle);
+}
+
+size_t RecordingJobContainer::RemoveBatch(std::vector<JobId> const& handles) {
+	auto now = Now();
+	for (auto handle : handles) {
+		writer_->Write(TraceOp::Remove, now, handle);
+	}
+	return inner_->RemoveBatch(handles);
+}
+
+bool RecordingJobContainer::Reschedule(JobId handle, TimeUnit expireTime) {
+	writer_->Write(TraceOp::Reschedule, Now(), handle, expireTime);
+	return inner_->Reschedule(handle, expireTime);
+}
+
+void RecordingJobContainer::RemoveAll() {
+	writer_->Write(TraceOp::RemoveAll, Now());
+	inner_->RemoveAll();
+}
+
+size_t RecordingJobContainer::PopExpires(TimeUnit now) {
+	// the writer may go away with the scheduler owning this container
+	auto writer = writer_;
+	writer->Write(TraceOp::Tick, now);
+	auto nExpires = inner_->PopExpires(now);
+	writer->Write(TraceOp::TickEnd, now);
+	return nExpires;
+}
+
+void RecordingJobContainer::RemoveJobs(JobPredicate pred) {
+	auto now = Now();
+	auto writer = writer_.get();
+	inner_->RemoveJobs([&pred, writer, now](Job const& job) {
+		if (!pred(job)) {
+			return false;
+		}
+		writer->Write(TraceOp::Remove, now, job.id_);
+		return true;
+	});
+}
+
+size_t RecordingJobContainer::RemoveJobsStep(RemoveCursor& cursor, JobPredicate pred, size_t budget) {
+	auto now = Now();
+	auto writer = writer_.get();
+	return inner_->RemoveJobsStep(cursor, [&pred, writer, now](Job const& job) {
+		if (!pred(job)) {
+			return false;
+		}
+		writer->Write(TraceOp::Remove, now, job.id_);
+		return true;
+	}, budget);
+}
+
+void RecordingJobContainer::RemoveSink(BatchExpireCallback* sink) {
+	auto it = sinks_.find(sink);
+	if (it == sinks_.end()) {
+		return;
+	}
+	inner_->RemoveSink(it->second.get());
+	sinks_.erase(it);
+}
+
+size_t RecordingJobContainer::RemoveGroup(GroupTag group) {
+	writer_->Write(TraceOp::RemoveGroup, Now(), 0, 0, group);
+	return inner_->RemoveGroup(group);
+}
+
+TimeUnit RecordingJobContainer::Now() const {
+	return clock_ ? clock_->Now() : writer_->LastTime();
+}
+
+ECPtr RecordingJobContainer::Wrap(ECPtr&& cb) {
+	return ECPtr(new ECRecordFire(writer_, std::move(cb)));
+}
+
+BatchExpireCallback* RecordingJobContainer::WrapSink(BatchExpireCallback* sink) {
+	auto& wrapped = sinks_[sink];
+	if (!wrapped) {
+		wrapped.reset(new RecordFireSink(writer_, sink));
+	}
+	return wrapped.get();
+}
+
+} // namespace elapse
\ No newline at end of file
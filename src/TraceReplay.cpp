@@ -0,0 +1,363 @@
+/*
+Author: ywx217@gmail.com
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#include "TraceReplay.hpp"
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+#include <utility>
+
+
+namespace elapse {
+
+namespace {
+
+typedef std::chrono::steady_clock StopwatchClock;
+
+std::uint64_t ElapsedNanos(StopwatchClock::time_point begin) {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(StopwatchClock::now() - begin).count();
+}
+
+// forwards to the default resource and tracks the peak of live bytes
+class PeakResource : public MemoryResource {
+public:
+	PeakResource() : bytes_(0), peak_(0) {}
+
+	size_t Peak() const { return peak_; }
+
+protected:
+	virtual void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+		bytes_ += bytes;
+		peak_ = std::max(peak_, bytes_);
+		return DefaultResource()->allocate(bytes, alignment);
+	}
+	virtual void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override {
+		bytes_ -= bytes;
+		DefaultResource()->deallocate(p, bytes, alignment);
+	}
+	virtual bool do_is_equal(MemoryResource const& other) const noexcept override {
+		return this == &other;
+	}
+
+private:
+	size_t bytes_;
+	size_t peak_;
+};
+
+class TraceReplayer : public BatchExpireCallback {
+public:
+	TraceReplayer(std::vector<TraceEvent> const& events, ContainerFactory const& factory) :
+		events_(events),
+		container_(factory(&resource_)),
+		now_(0),
+		inTick_(false),
+		stats_() {}
+	virtual ~TraceReplayer() {
+		// callbacks must go before the resource
+		container_.reset();
+	}
+
+	ReplayStats Run();
+
+	// batched jobs of the trace, fired like the others
+	virtual void operator()(JobId const* ids, size_t count) override;
+
+private:
+	struct Mapped {
+		JobId id;
+		TimeUnit expire;
+		GroupTag group;
+	};
+	typedef std::pair<size_t, size_t> Segment;
+
+	size_t ReplayTick(size_t begin);
+	// applies one event, returns true if it rescheduled `self`
+	bool Apply(TraceEvent const& event, JobId self = 0);
+	void OnFire(JobId traceId);
+	bool RunSegment(Segment segment, JobId traceId);
+	ECPtr MakeCallback(JobId traceId);
+
+private:
+	std::vector<TraceEvent> const& events_;
+	PeakResource resource_;
+	std::unique_ptr<JobContainer> container_;
+	TimeUnit now_;
+	// container time of the callbacks is already part of the tick
+	bool inTick_;
+	ReplayStats stats_;
+	// trace id -> replay job
+	std::unordered_map<JobId, Mapped> jobs_;
+	// replay id -> trace id of the batched jobs
+	std::unordered_map<JobId, JobId> batched_;
+	// events issued from the callbacks of the current tick, by trace id
+	std::unordered_map<JobId, Segment> segments_;
+	std::vector<std::uint64_t> adds_, removes_, reschedules_, ticks_, lateness_;
+};
+
+ReplayStats TraceReplayer::Run() {
+	for (size_t i = 0; i < events_.size(); ++i) {
+		if (events_[i].op_ == TraceOp::Tick) {
+			i = ReplayTick(i);
+		} else if (events_[i].op_ != TraceOp::Fire && events_[i].op_ != TraceOp::TickEnd) {
+			now_ = events_[i].time_;
+			Apply(events_[i]);
+		}
+		stats_.peakJobs_ = std::max(stats_.peakJobs_, container_->Size());
+	}
+	stats_.events_ = events_.size();
+	stats_.peakBytes_ = resource_.Peak();
+	stats_.add_ = LatencyStats::From(adds_);
+	stats_.remove_ = LatencyStats::From(removes_);
+	stats_.reschedule_ = LatencyStats::From(reschedules_);
+	stats_.tick_ = LatencyStats::From(ticks_);
+	stats_.lateness_ = LatencyStats::From(lateness_);
+	return stats_;
+}
+
+size_t TraceReplayer::ReplayTick(size_t begin) {
+	now_ = events_[begin].time_;
+	// split the events of the tick by the job whose callback issued them
+	segments_.clear();
+	size_t end = begin + 1;
+	JobId firing = 0;
+	// issued outside of the per-job callbacks, e.g. by batch sinks
+	std::vector<size_t> loose;
+	for (; end < events_.size() && events_[end].op_ != TraceOp::TickEnd; ++end) {
+		if (events_[end].op_ == TraceOp::Fire) {
+			firing = events_[end].id_;
+			segments_[firing] = Segment(end + 1, end + 1);
+		} else if (firing) {
+			segments_[firing].second = end + 1;
+		} else {
+			loose.push_back(end);
+		}
+	}
+	++stats_.ticks_;
+	auto start = StopwatchClock::now();
+	inTick_ = true;
+	container_->PopExpires(now_);
+	inTick_ = false;
+	auto nanos = ElapsedNanos(start);
+	ticks_.push_back(nanos);
+	stats_.seconds_ += nanos * 1e-9;
+	// fired in the trace only, keep the state in line with it
+	while (!segments_.empty()) {
+		auto it = segments_.begin();
+		auto traceId = it->first;
+		auto segment = it->second;
+		segments_.erase(it);
+		++stats_.missedFires_;
+		if (!RunSegment(segment, traceId)) {
+			auto job = jobs_.find(traceId);
+			if (job != jobs_.end()) {
+				container_->Remove(job->second.id);
+				batched_.erase(job->second.id);
+				jobs_.erase(job);
+			}
+		}
+	}
+	for (auto i : loose) {
+		if (events_[i].op_ != TraceOp::Tick) {
+			Apply(events_[i]);
+		}
+	}
+	return end;
+}
+
+bool TraceReplayer::Apply(TraceEvent const& event, JobId self) {
+	bool rescheduledSelf = false;
+	// only the container call is timed, not the bookkeeping around it
+	std::uint64_t nanos = 0;
+	auto start = StopwatchClock::now();
+	switch (event.op_) {
+	case TraceOp::Add: {
+		auto id = container_->Add(event.expire_, MakeCallback(event.id_), event.group_);
+		nanos = ElapsedNanos(start);
+		adds_.push_back(nanos);
+		jobs_[event.id_] = Mapped{id, event.expire_, event.group_};
+		break;
+	}
+	case TraceOp::AddBatched: {
+		auto id = container_->AddBatched(event.expire_, this, event.group_);
+		nanos = ElapsedNanos(start);
+		adds_.push_back(nanos);
+		jobs_[event.id_] = Mapped{id, event.expire_, event.group_};
+		batched_[id] = event.id_;
+		break;
+	}
+	case TraceOp::AddImmediate: {
+		auto id = container_->AddImmediate(MakeCallback(event.id_), event.group_);
+		nanos = ElapsedNanos(start);
+		adds_.push_back(nanos);
+		jobs_[event.id_] = Mapped{id, now_, event.group_};
+		break;
+	}
+	case TraceOp::Remove: {
+		auto it = jobs_.find(event.id_);
+		if (it == jobs_.end()) {
+			return false;
+		}
+		start = StopwatchClock::now();
+		container_->Remove(it->second.id);
+		nanos = ElapsedNanos(start);
+		removes_.push_back(nanos);
+		batched_.erase(it->second.id);
+		jobs_.erase(it);
+		break;
+	}
+	case TraceOp::Reschedule: {
+		auto it = jobs_.find(event.id_);
+		if (it == jobs_.end()) {
+			return false;
+		}
+		start = StopwatchClock::now();
+		container_->Reschedule(it->second.id, event.expire_);
+		nanos = ElapsedNanos(start);
+		reschedules_.push_back(nanos);
+		it->second.expire = event.expire_;
+		rescheduledSelf = event.id_ == self;
+		break;
+	}
+	case TraceOp::RemoveAll:
+		container_->RemoveAll();
+		nanos = ElapsedNanos(start);
+		removes_.push_back(nanos);
+		jobs_.clear();
+		batched_.clear();
+		break;
+	case TraceOp::RemoveGroup:
+		container_->RemoveGroup(event.group_);
+		nanos = ElapsedNanos(start);
+		removes_.push_back(nanos);
+		for (auto it = jobs_.begin(); it != jobs_.end();) {
+			if (it->second.group == event.group_) {
+				batched_.erase(it->second.id);
+				it = jobs_.erase(it);
+			} else {
+				++it;
+			}
+		}
+		break;
+	default:
+		return false;
+	}
+	if (!inTick_) {
+		stats_.seconds_ += nanos * 1e-9;
+	}
+	return rescheduledSelf;
+}
+
+void TraceReplayer::OnFire(JobId traceId) {
+	++stats_.fires_;
+	auto job = jobs_.find(traceId);
+	if (job != jobs_.end() && now_ >= job->second.expire) {
+		lateness_.push_back(now_ - job->second.expire);
+	}
+	auto it = segments_.find(traceId);
+	if (it == segments_.end()) {
+		++stats_.extraFires_;
+		jobs_.erase(traceId);
+		return;
+	}
+	auto segment = it->second;
+	segments_.erase(it);
+	if (!RunSegment(segment, traceId)) {
+		jobs_.erase(traceId);
+	}
+}
+
+bool TraceReplayer::RunSegment(Segment segment, JobId traceId) {
+	bool rescheduled = false;
+	for (auto i = segment.first; i < segment.second; ++i) {
+		// nested ticks are not replayed
+		if (events_[i].op_ != TraceOp::Tick && events_[i].op_ != TraceOp::Fire) {
+			rescheduled |= Apply(events_[i], traceId);
+		}
+	}
+	return rescheduled;
+}
+
+void TraceReplayer::operator()(JobId const* ids, size_t count) {
+	for (size_t i = 0; i < count; ++i) {
+		auto it = batched_.find(ids[i]);
+		if (it == batched_.end()) {
+			continue;
+		}
+		auto traceId = it->second;
+		batched_.erase(it);
+		OnFire(traceId);
+		// collected batched jobs have left the container, a reschedule does not keep them
+		auto job = jobs_.find(traceId);
+		if (job != jobs_.end() && job->second.id == ids[i]) {
+			jobs_.erase(job);
+		}
+	}
+}
+
+ECPtr TraceReplayer::MakeCallback(JobId traceId) {
+	return WrapLambdaPtr(&resource_, [this, traceId](JobId id) { OnFire(traceId); });
+}
+
+} // namespace
+
+bool LoadTrace(std::istream& is, std::vector<TraceEvent>& events) {
+	TraceReader reader(is);
+	if (!reader.Valid()) {
+		return false;
+	}
+	TraceEvent event;
+	while (reader.Next(event)) {
+		events.push_back(event);
+	}
+	return true;
+}
+
+ReplayStats ReplayTrace(std::vector<TraceEvent> const& events, ContainerFactory const& factory) {
+	TraceReplayer replayer(events, factory);
+	return replayer.Run();
+}
+
+void PrintReplayStats(std::ostream& os, ReplayStats const& stats) {
+	auto print = [&os](char const* name, LatencyStats const& latency) {
+		os << "  " << name << ": n=" << latency.count_ << " p50=" << latency.p50_ << " p90=" << latency.p90_
+			<< " p99=" << latency.p99_ << " max=" << latency.max_ << std::endl;
+	};
+	os << "events=" << stats.events_ << " ticks=" << stats.ticks_ << " fires=" << stats.fires_
+		<< " missed=" << stats.missedFires_ << " extra=" << stats.extraFires_ << std::endl;
+	os << "container time=" << stats.seconds_ << "s throughput=" << stats.EventsPerSecond() << " events/s" << std::endl;
+	os << "peak jobs=" << stats.peakJobs_ << " peak bytes=" << stats.peakBytes_ << std::endl;
+	os << "latency (ns):" << std::endl;
+	print("add", stats.add_);
+	print("remove", stats.remove_);
+	print("reschedule", stats.reschedule_);
+	print("tick", stats.tick_);
+	os << "fire lateness (time units):" << std::endl;
+	print("lateness", stats.lateness_);
+}
+
+} // namespace elapse
\ No newline at end of file
@@ -26,6 +26,7 @@ OTHER DEALINGS IN THE SOFTWARE.
 
 For more information, please refer to <http://unlicense.org>
 */
+#include <algorithm>
 #include "TreeJobContainer.hpp"
 #ifdef DEBUG_PRINT
 #include <iostream>
@@ -42,21 +43,87 @@ TreeJobContainer::~TreeJobContainer() {
 }
 
 JobId TreeJobContainer::Add(TimeUnit expireTime, ECPtr&& cb) {
-	JobId id = nextId_++;
-	while (nextId_ == 0 || jobs_.find(nextId_) != jobs_.end()) {
-		++nextId_;
-	}
-	jobs_.emplace(id, expireTime, std::move(cb));
+	return Add(expireTime, std::move(cb), NullGroup);
+}
+
+JobId TreeJobContainer::Add(TimeUnit expireTime, ECPtr&& cb, GroupTag group) {
+	JobId id = NextId();
+	Add(id, expireTime, std::move(cb), group);
+	return id;
+}
+
+void TreeJobContainer::Add(JobId id, TimeUnit expireTime, ECPtr&& cb, GroupTag group) {
+	jobs_.emplace(id, expireTime, std::move(cb), group);
 	#ifdef DEBUG_PRINT
-	std::cout << "  + job-" << id << " expire=" << expireTime << std::endl;
+	std::cout << "  + job-" << id << " expire=" << expireTime << " group=" << group << std::endl;
 	#endif
+}
+
+JobId TreeJobContainer::AddImmediate(ECPtr&& cb, GroupTag group) {
+	JobId id = NextId();
+	immediates_.emplace_back(id, immediateEpoch_, std::move(cb), group);
+	#ifdef DEBUG_PRINT
+	std::cout << "  + job-" << id << " immediate group=" << group << std::endl;
+	#endif
+	return id;
+}
+
+JobId TreeJobContainer::AddBatched(TimeUnit expireTime, BatchExpireCallback* sink, GroupTag group) {
+	JobId id = NextId();
+	AddBatched(id, expireTime, sink, group);
 	return id;
 }
 
+void TreeJobContainer::AddBatched(JobId id, TimeUnit expireTime, BatchExpireCallback* sink, GroupTag group) {
+	jobs_.emplace(id, expireTime, sink, group);
+	#ifdef DEBUG_PRINT
+	std::cout << "  + job-" << id << " expire=" << expireTime << " group=" << group << " batched" << std::endl;
+	#endif
+}
+
+void TreeJobContainer::AddBatch(std::vector<BatchJob>& jobs) {
+	if (jobs.empty()) {
+		return;
+	}
+	// insert in expire order, each job is then hinted right after the previous one
+	std::vector<BatchJob*> sorted;
+	sorted.reserve(jobs.size());
+	for (auto& job : jobs) {
+		sorted.push_back(&job);
+	}
+	std::stable_sort(sorted.begin(), sorted.end(), [](BatchJob const* a, BatchJob const* b) {
+		return a->expire_ < b->expire_;
+	});
+	auto size = jobs_.size() + jobs.size();
+	boost::multi_index::get<id>(jobs_).reserve(size);
+	boost::multi_index::get<group>(jobs_).reserve(size);
+	auto& expireIndex = boost::multi_index::get<expire>(jobs_);
+	auto hint = expireIndex.upper_bound(sorted.front()->expire_);
+	for (auto job : sorted) {
+		job->id_ = NextId();
+		hint = expireIndex.emplace_hint(hint, job->id_, job->expire_, std::move(job->cb_), job->group_);
+		++hint;
+		#ifdef DEBUG_PRINT
+		std::cout << "  + job-" << job->id_ << " expire=" << job->expire_ << " group=" << job->group_ << std::endl;
+		#endif
+	}
+}
+
+void TreeJobContainer::RemoveSink(BatchExpireCallback* sink) {
+	auto slot = batchSlots_.find(sink);
+	if (slot == batchSlots_.end()) {
+		return;
+	}
+	// FlushBatches may be walking the slots, so they are not erased here
+	batches_[slot->second].first = nullptr;
+	batches_[slot->second].second.clear();
+	batchSlots_.erase(slot);
+}
+
 bool TreeJobContainer::Remove(JobId handle) {
 	auto it = Find<id>(handle);
 	if (it == jobs_.end()) {
-		return false;
+		return !immediates_.empty() && boost::multi_index::get<id>(immediates_).erase(handle) > 0;
 	}
 	#ifdef DEBUG_PRINT
 	std::cout << "  - job-" << it->id_ << " removed" << std::endl;
@@ -65,8 +132,86 @@ bool TreeJobContainer::Remove(JobId handle) {
 	return true;
 }
 
+size_t TreeJobContainer::RemoveBatch(std::vector<JobId> const& handles) {
+	auto& idIndex = boost::multi_index::get<id>(jobs_);
+	size_t nRemoved = 0;
+	auto& immediateIndex = boost::multi_index::get<id>(immediates_);
+	for (auto handle : handles) {
+		auto n = idIndex.erase(handle);
+		if (!n && !immediates_.empty()) {
+			n = immediateIndex.erase(handle);
+		}
+		nRemoved += n;
+	}
+	return nRemoved;
+}
+
+bool TreeJobContainer::Reschedule(JobId handle, TimeUnit expireTime) {
+	auto it = Find<id>(handle);
+	if (it == jobs_.end()) {
+		return !immediates_.empty() && RescheduleImmediate(handle, expireTime);
+	}
+	#ifdef DEBUG_PRINT
+	std::cout << "  * job-" << it->id_ << " expire=" << expireTime << std::endl;
+	#endif
+	jobs_.modify(it, [expireTime](Job& job) { job.expire_ = expireTime; });
+	return true;
+}
+
+bool TreeJobContainer::RescheduleImmediate(JobId handle, TimeUnit expireTime) {
+	auto& idIndex = boost::multi_index::get<id>(immediates_);
+	auto it = idIndex.find(handle);
+	if (it == idIndex.end()) {
+		return false;
+	}
+	ECPtr cb;
+	auto group = it->group_;
+	idIndex.modify(it, [&cb](Job& job) { cb = job.TakeCallback(); });
+	// a firing job is erased by PopImmediates once its callback returns
+	if (handle != firingImmediate_) {
+		idIndex.erase(it);
+	}
+	Add(handle, expireTime, std::move(cb), group);
+	return true;
+}
+
+size_t TreeJobContainer::MoveExpiring(TimeUnit limit, TreeJobContainer& to) {
+	auto& expireIndex = boost::multi_index::get<expire>(jobs_);
+	auto& toIndex = boost::multi_index::get<expire>(to.jobs_);
+	size_t nMoved = 0;
+	// inserting at the end of equal expire times keeps the firing order
+	for (auto it = expireIndex.begin(); it != expireIndex.end() && it->expire_ < limit; it = expireIndex.begin()) {
+		auto hint = toIndex.upper_bound(it->expire_);
+		toIndex.insert(hint, expireIndex.extract(it));
+		++nMoved;
+	}
+	return nMoved;
+}
+
+size_t TreeJobContainer::MoveExpiringFrom(TimeUnit limit, TreeJobContainer& to) {
+	auto& expireIndex = boost::multi_index::get<expire>(jobs_);
+	auto& toIndex = boost::multi_index::get<expire>(to.jobs_);
+	size_t nMoved = 0;
+	for (auto it = expireIndex.lower_bound(limit); it != expireIndex.end(); ++nMoved) {
+		auto hint = toIndex.upper_bound(it->expire_);
+		toIndex.insert(hint, expireIndex.extract(it++));
+	}
+	return nMoved;
+}
+
+bool TreeJobContainer::MoveJob(JobId handle, TreeJobContainer& to) {
+	auto it = Find<id>(handle);
+	if (it == jobs_.end()) {
+		return false;
+	}
+	// the job keeps its address, so this is safe from its own callback
+	to.jobs_.insert(jobs_.extract(it));
+	return true;
+}
+
 void TreeJobContainer::RemoveAll() {
 	jobs_.clear();
+	immediates_.clear();
 }
 
 size_t TreeJobContainer::PopExpires(TimeUnit now) {
@@ -75,6 +220,11 @@ size_t TreeJobContainer::PopExpires(TimeUnit now) {
 	auto& expireIndex = boost::multi_index::get<expire>(jobs_);
 	auto& idIndex = boost::multi_index::get<id>(jobs_);
 	bool destroyWhenFiring = false;
+	bool hasBatches = false;
+	if (!immediates_.empty() && !PopImmediates(nExpires)) {
+		return nExpires;
+	}
+	auto lastBatch = batches_.end();
 	while (true) {
 		auto it = expireIndex.begin();
 		if (it == expireIndex.end() || !it->IsExpired(now)) {
@@ -83,6 +233,20 @@ size_t TreeJobContainer::PopExpires(TimeUnit now) {
 		#ifdef DEBUG_PRINT
 		std::cout << "[" << now << "] - job-" << it->id_ << " fired" << std::endl;
 		#endif
+		if (it->batch_) {
+			if (lastBatch == batches_.end() || lastBatch->first != it->batch_) {
+				auto slot = batchSlots_.emplace(it->batch_, batches_.size());
+				if (slot.second) {
+					batches_.emplace_back(it->batch_, std::vector<JobId>());
+				}
+				lastBatch = batches_.begin() + slot.first->second;
+			}
+			lastBatch->second.push_back(it->id_);
+			expireIndex.erase(it);
+			hasBatches = true;
+			++nExpires;
+			continue;
+		}
 		expiredId = it->id_;
 		destroyFlag_ = &destroyWhenFiring;
 		it->Fire();
@@ -90,13 +254,135 @@ size_t TreeJobContainer::PopExpires(TimeUnit now) {
 			return nExpires;
 		}
 		destroyFlag_ = nullptr;
-		idIndex.erase(expiredId);
+		// keep the job if its callback rescheduled it
+		auto fired = idIndex.find(expiredId);
+		if (fired != idIndex.end() && fired->IsExpired(now)) {
+			idIndex.erase(fired);
+		}
 		++nExpires;
 	}
+	if (hasBatches) {
+		FlushBatches();
+	}
 	return nExpires;
 }
 
+bool TreeJobContainer::PopImmediates(size_t& nExpires) {
+	// jobs added by the callbacks wait for the next call
+	auto epoch = immediateEpoch_++;
+	auto& idIndex = boost::multi_index::get<id>(immediates_);
+	bool destroyWhenFiring = false;
+	while (!immediates_.empty() && immediates_.front().expire_ <= epoch) {
+		auto const& job = immediates_.front();
+		#ifdef DEBUG_PRINT
+		std::cout << "  - job-" << job.id_ << " fired immediately" << std::endl;
+		#endif
+		auto expiredId = job.id_;
+		destroyFlag_ = &destroyWhenFiring;
+		firingImmediate_ = expiredId;
+		job.Fire();
+		if (destroyWhenFiring) {
+			return false;
+		}
+		destroyFlag_ = nullptr;
+		firingImmediate_ = 0;
+		idIndex.erase(expiredId);
+		++nExpires;
+	}
+	return true;
+}
+
+bool TreeJobContainer::FlushBatches() {
+	bool destroyWhenFiring = false;
+	std::vector<JobId> ids;
+	for (size_t i = 0; i < batches_.size(); ++i) {
+		if (batches_[i].second.empty()) {
+			continue;
+		}
+		// sinks may add or remove jobs, even of their own batch
+		ids.swap(batches_[i].second);
+		auto sink = batches_[i].first;
+		destroyFlag_ = &destroyWhenFiring;
+		(*sink)(ids.data(), ids.size());
+		if (destroyWhenFiring) {
+			return false;
+		}
+		destroyFlag_ = nullptr;
+		ids.clear();
+		ids.swap(batches_[i].second);
+	}
+	return true;
+}
+
+JobId TreeJobContainer::NextId() {
+	JobId id = nextId_++;
+	while (nextId_ == 0 || jobs_.find(nextId_) != jobs_.end() ||
+			(!immediates_.empty() && boost::multi_index::get<elapse::id>(immediates_).count(nextId_))) {
+		++nextId_;
+	}
+	return id;
+}
+
+TimeUnit TreeJobContainer::EarliestExpire() const {
+	if (!immediates_.empty()) {
+		return 1;
+	}
+	auto& expireIndex = boost::multi_index::get<expire>(jobs_);
+	return expireIndex.empty() ? 0 : expireIndex.begin()->expire_;
+}
+
+MemoryUsage TreeJobContainer::Memory() const {
+	MemoryUsage usage;
+	// two hashed and one ordered index per job, a list and two hashed per immediate
+	usage.nodes_ += jobs_.size() * (sizeof(Job) + 7 * sizeof(void*));
+	usage.nodes_ += immediates_.size() * (sizeof(Job) + 6 * sizeof(void*));
+	usage.AddHashIndex(boost::multi_index::get<id>(jobs_));
+	usage.AddHashIndex(boost::multi_index::get<group>(jobs_));
+	usage.AddHashIndex(boost::multi_index::get<id>(immediates_));
+	usage.AddHashIndex(boost::multi_index::get<group>(immediates_));
+	for (auto const& job : jobs_) {
+		usage.callbacks_ += job.CallbackBytes();
+	}
+	for (auto const& job : immediates_) {
+		usage.callbacks_ += job.CallbackBytes();
+	}
+	usage.other_ += batches_.capacity() * sizeof(decltype(batches_)::value_type);
+	usage.AddHashMap(batchSlots_);
+	for (auto const& batch : batches_) {
+		usage.other_ += batch.second.capacity() * sizeof(JobId);
+	}
+	return usage;
+}
+
+void TreeJobContainer::Compact() {
+	// the expire order is walked while firing, and so are the batch buffers
+	if (destroyFlag_) {
+		return;
+	}
+	if (boost::multi_index::get<id>(jobs_).bucket_count() > 2 * jobs_.size() + 64) {
+		// jobs of the same expire time keep their firing order
+		CompactSet(jobs_, boost::multi_index::get<expire>(jobs_));
+	}
+	if (boost::multi_index::get<id>(immediates_).bucket_count() > 2 * immediates_.size() + 64) {
+		CompactSet(immediates_, immediates_);
+	}
+	batches_.erase(std::remove_if(batches_.begin(), batches_.end(),
+		[](decltype(batches_)::value_type const& batch) { return batch.second.empty(); }), batches_.end());
+	batchSlots_.clear();
+	for (size_t i = 0; i < batches_.size(); ++i) {
+		batches_[i].second.shrink_to_fit();
+		batchSlots_.emplace(batches_[i].first, i);
+	}
+	batches_.shrink_to_fit();
+	batchSlots_.rehash(0);
+}
+
 void TreeJobContainer::IterJobs(JobPredicate pred) const {
+	for (auto const& it : immediates_) {
+		if (!pred(it)) {
+			return;
+		}
+	}
 	for (auto const& it : jobs_) {
 		if (!pred(it)) {
 			break;
@@ -105,6 +391,13 @@ void TreeJobContainer::IterJobs(JobPredicate pred) const {
 }
 
 void TreeJobContainer::RemoveJobs(JobPredicate pred) {
+	for (auto it = immediates_.begin(); it != immediates_.end();) {
+		if (pred(*it)) {
+			it = immediates_.erase(it);
+		} else {
+			++it;
+		}
+	}
 	auto& idIndex = boost::multi_index::get<id>(jobs_);
 	for (auto it = idIndex.begin(); it != idIndex.end();) {
 		if (pred(*it)) {
@@ -115,4 +408,98 @@ void TreeJobContainer::RemoveJobs(JobPredicate pred) {
 	}
 }
 
+size_t TreeJobContainer::RemoveJobsStep(RemoveCursor& cursor, JobPredicate pred, size_t budget) {
+	size_t nRemoved = 0;
+	if (cursor.phase_ == RemoveCursor::kImmediates) {
+		auto it = immediates_.begin();
+		if (cursor.next_) {
+			// gone once drained, and so are the ones before it
+			auto found = boost::multi_index::get<id>(immediates_).find(cursor.next_);
+			if (found != boost::multi_index::get<id>(immediates_).end()) {
+				it = immediates_.project<0>(found);
+			}
+		}
+		for (; it != immediates_.end() && budget; --budget, ++cursor.visited_) {
+			if (pred(*it)) {
+				it = immediates_.erase(it);
+				++nRemoved;
+			} else {
+				++it;
+			}
+		}
+		if (it != immediates_.end()) {
+			cursor.next_ = it->id_;
+			cursor.removed_ += nRemoved;
+			return nRemoved;
+		}
+		cursor.phase_ = RemoveCursor::kJobs;
+		cursor.next_ = 0;
+	}
+	if (cursor.phase_ == RemoveCursor::kJobs) {
+		auto& expireIndex = boost::multi_index::get<expire>(jobs_);
+		auto it = expireIndex.begin();
+		if (cursor.next_) {
+			// a fired, removed or moved job resumes at the expire time the cursor stopped at
+			auto found = jobs_.find(cursor.next_);
+			if (found != jobs_.end() && found->expire_ == cursor.expire_) {
+				it = jobs_.project<expire>(found);
+			} else {
+				it = expireIndex.lower_bound(cursor.expire_);
+			}
+		}
+		for (; it != expireIndex.end() && budget; --budget, ++cursor.visited_) {
+			if (pred(*it)) {
+				it = expireIndex.erase(it);
+				++nRemoved;
+			} else {
+				++it;
+			}
+		}
+		if (it != expireIndex.end()) {
+			cursor.next_ = it->id_;
+			cursor.expire_ = it->expire_;
+			cursor.removed_ += nRemoved;
+			return nRemoved;
+		}
+		cursor.phase_ = RemoveCursor::kDone;
+		cursor.next_ = 0;
+	}
+	cursor.removed_ += nRemoved;
+	return nRemoved;
+}
+
+size_t TreeJobContainer::RemoveGroup(GroupTag group) {
+	auto& groupIndex = boost::multi_index::get<elapse::group>(jobs_);
+	auto range = groupIndex.equal_range(group);
+	size_t nRemoved = std::distance(range.first, range.second);
+	groupIndex.erase(range.first, range.second);
+	if (!immediates_.empty()) {
+		nRemoved += boost::multi_index::get<elapse::group>(immediates_).erase(group);
+	}
+	return nRemoved;
+}
+
+size_t TreeJobContainer::CountGroup(GroupTag group) const {
+	auto nJobs = boost::multi_index::get<elapse::group>(jobs_).count(group);
+	if (!immediates_.empty()) {
+		nJobs += boost::multi_index::get<elapse::group>(immediates_).count(group);
+	}
+	return nJobs;
+}
+
+void TreeJobContainer::IterGroup(GroupTag group, JobPredicate pred) const {
+	auto immediates = boost::multi_index::get<elapse::group>(immediates_).equal_range(group);
+	for (auto it = immediates.first; it != immediates.second; ++it) {
+		if (!pred(*it)) {
+			return;
+		}
+	}
+	auto range = boost::multi_index::get<elapse::group>(jobs_).equal_range(group);
+	for (auto it = range.first; it != range.second; ++it) {
+		if (!pred(*it)) {
+			break;
+		}
+	}
+}
+
 } // namespace elapse
\ No newline at end of file
@@ -1,6 +1,13 @@
 #include "gtest/gtest.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
 #include <tuple>
 #include "Crontab.hpp"
+#include "CronParser.hpp"
+#include "CronSpecSet.hpp"
 #include "Clock.hpp"
 
 using namespace elapse::crontab;
@@ -16,6 +23,7 @@ std::time_t MakeTime(int year, int month, int date, int hour, int minute, int se
 	tm.tm_hour = hour;
 	tm.tm_min = minute;
 	tm.tm_sec = second;
+	tm.tm_isdst = -1;
 	return std::mktime(&tm);
 }
 
@@ -129,3 +137,281 @@ TEST(Crontab, CycleFirstDelay) {
 		ASSERT_EQ(0, c.NextExpire(clock));
 	}
 }
+
+constexpr CronSpec MakeDailySpec(std::size_t hour, std::size_t minute, std::size_t second) {
+	CronSpec spec;
+	spec.Parse(hour, minute, second);
+	return spec;
+}
+
+TEST(Crontab, CompactSpec) {
+	constexpr CronSpec daily = MakeDailySpec(4, 30, 0);
+	static_assert(daily.Hour().Fits(4) && !daily.Hour().Fits(5), "constexpr spec");
+	static_assert(std::is_trivially_copyable<CronSpec>::value, "trivially copyable");
+	ASSERT_LE(sizeof(CronSpec), 56);
+
+	Crontab cron;
+	cron.Parse(4, 30, 0);
+	ASSERT_TRUE(cron.Spec() == daily);
+	ASSERT_EQ(std::hash<CronSpec>()(daily), std::hash<CronSpec>()(cron.Spec()));
+
+	CronSpec other = daily;
+	other.Second().SetSingle(1);
+	ASSERT_TRUE(other != daily);
+	ASSERT_NE(std::hash<CronSpec>()(daily), std::hash<CronSpec>()(other));
+
+	std::time_t t1 = MakeTime(2018, 5, 7, 12, 0, 0), t2 = t1;
+	ASSERT_TRUE(daily.FindNext(t1));
+	ASSERT_TRUE(cron.FindNext(t2));
+	ASSERT_EQ(t1, t2);
+}
+
+
+TEST(Crontab, CronLiteral) {
+	using namespace elapse::crontab::literals;
+	constexpr CronSpec every5Minutes = "0 */5 * * * *"_cron;
+	static_assert(every5Minutes.Minute().Fits(55) && !every5Minutes.Minute().Fits(56), "constexpr literal");
+
+	CronSpec expect;
+	expect.SetAll();
+	expect.Second().Clear().SetSingle(0);
+	expect.Minute().Clear();
+	for (std::size_t m = 0; m < 60; m += 5) {
+		expect.Minute().SetSingle(m);
+	}
+	ASSERT_TRUE(every5Minutes == expect);
+
+	constexpr CronSpec weekdays = "30 0 9-17/4 1,15 * 1-5 2018-2020"_cron;
+	ASSERT_TRUE(weekdays.Hour().Fits(9));
+	ASSERT_TRUE(weekdays.Hour().Fits(13));
+	ASSERT_TRUE(weekdays.Hour().Fits(17));
+	ASSERT_FALSE(weekdays.Hour().Fits(10));
+	ASSERT_TRUE(weekdays.DayOfMonth().Fits(15));
+	ASSERT_FALSE(weekdays.DayOfMonth().Fits(2));
+	ASSERT_FALSE(weekdays.DayOfWeek().Fits(0));
+	ASSERT_TRUE(weekdays.Year().Fits(2019));
+	ASSERT_FALSE(weekdays.Year().Fits(2021));
+
+	constexpr CronSpec sunday = "0 0 0 * * 7"_cron;
+	ASSERT_TRUE(sunday.DayOfWeek().Fits(0));
+}
+
+TEST(Crontab, CronParseErrors) {
+	CronSpec spec;
+	ASSERT_EQ(CronParseError::None, TryParseCron("0 0 12 * * *", 12, spec));
+	ASSERT_EQ(CronParseError::FieldCount, TryParseCron("0 0 12 * *", 10, spec));
+	ASSERT_EQ(CronParseError::FieldCount, TryParseCron("0 0 12 * * * * *", 16, spec));
+	ASSERT_EQ(CronParseError::OutOfRange, TryParseCron("60 0 12 * * *", 13, spec));
+	ASSERT_EQ(CronParseError::OutOfRange, TryParseCron("0 0 12 0 * *", 12, spec));
+	ASSERT_EQ(CronParseError::BadRange, TryParseCron("0 0 12-3 * * *", 14, spec));
+	ASSERT_EQ(CronParseError::BadStep, TryParseCron("0 */0 12 * * *", 14, spec));
+	ASSERT_EQ(CronParseError::BadCharacter, TryParseCron("0 a 12 * * *", 12, spec));
+	ASSERT_EQ(CronParseError::EmptyField, TryParseCron("0 1, 12 * * *", 13, spec));
+	ASSERT_THROW(ParseCron("0 0 25 * * *", 12), std::invalid_argument);
+	ASSERT_EQ(CronParseError::NeverFires, TryParseCron("0 0 0 30 2 *", 12, spec));
+	ASSERT_EQ(CronParseError::NeverFires, TryParseCron("0 0 0 29 2 * 2021-2023", 22, spec));
+	ASSERT_EQ(CronParseError::None, TryParseCron("0 0 0 29 2 * 2021-2024", 22, spec));
+	ASSERT_EQ(CronParseError::None, TryParseCron("0 0 0 30-31 2,4 *", 17, spec));
+}
+
+TEST(Crontab, RareAndNeverFiring) {
+	CronSpec spec;
+	// day 31 of february is rejected by the parser, masks set by hand still have to terminate
+	spec.SetAll();
+	spec.DayOfMonth().Clear().SetSingle(31);
+	spec.Month().Clear().SetSingle(2);
+	ASSERT_FALSE(spec.Feasible());
+	std::time_t t = MakeTime(2018, 5, 7, 12, 0, 0);
+	ASSERT_FALSE(spec.FindNext(t));
+
+	// leap day on a monday
+	ASSERT_EQ(CronParseError::None, TryParseCron("0 0 0 29 2 1", 12, spec));
+	t = MakeTime(2018, 5, 7, 12, 0, 0);
+	ASSERT_TRUE(spec.FindNext(t));
+	ASSERT_EQ(MakeTime(2044, 2, 29, 0, 0, 0), t);
+	ASSERT_TRUE(spec.FindNext(t));
+	ASSERT_EQ(MakeTime(2072, 2, 29, 0, 0, 0), t);
+	ASSERT_FALSE(spec.FindNext(t));
+
+	// friday the 13th
+	ASSERT_EQ(CronParseError::None, TryParseCron("0 30 8 13 * 5", 13, spec));
+	t = MakeTime(2018, 5, 7, 12, 0, 0);
+	ASSERT_TRUE(spec.FindNext(t));
+	ASSERT_EQ(MakeTime(2018, 7, 13, 8, 30, 0), t);
+
+	// past the last year of the field
+	ASSERT_EQ(CronParseError::None, TryParseCron("0 0 0 * * * 2017", 16, spec));
+	t = MakeTime(2018, 5, 7, 12, 0, 0);
+	ASSERT_FALSE(spec.FindNext(t));
+}
+
+TEST(Crontab, BenchFindNext) {
+	const char* exprs[] = {
+		"* * * * * *",
+		"0 */5 * * * *",
+		"0 0 9-17 * * 1-5",
+		"0 0 0 1 */3 *",
+		"0 30 8 13 * 5",
+		"0 0 0 29 2 *",
+		"0 0 0 29 2 1",
+		"59 59 23 31 12 * 2099",
+	};
+	const std::time_t base = MakeTime(2018, 5, 7, 12, 0, 0);
+	for (auto expr : exprs) {
+		CronSpec spec;
+		ASSERT_EQ(CronParseError::None, TryParseCron(expr, std::strlen(expr), spec));
+		int found = 0;
+		auto begin = std::chrono::steady_clock::now();
+		for (int i = 0; i < 10000; ++i) {
+			std::time_t t = base + i * 3607;
+			found += spec.FindNext(t) ? 1 : 0;
+		}
+		auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+		ASSERT_EQ(10000, found);
+		std::cout << expr << ": " << ns / 10000 << " ns per FindNext" << std::endl;
+	}
+}
+
+TEST(Crontab, LocalCalendar) {
+	// a zone with dst, restored afterwards
+	auto tz = std::getenv("TZ");
+	std::string oldTz = tz ? tz : "";
+	setenv("TZ", "Europe/Berlin", 1);
+	tzset();
+
+	LocalCalendar calendar;
+	size_t fast = 0, total = 0;
+	for (std::time_t now = MakeTime(2018, 1, 1, 0, 0, 0); now < MakeTime(2019, 1, 1, 0, 0, 0); now += 7 * 3600 + 13 * 60 + 17) {
+		std::size_t hour = now % 24, minute = (now / 7) % 60, second = now % 60, week = now % 8;
+		std::size_t month = now % 12 + 1, date = (now / 13) % 31 + 1;
+		CronSpec daily, weekly, yearly;
+		daily.Parse(hour, minute, second);
+		weekly.Parse(week, hour, minute, second);
+		yearly.Parse(month, date, hour, minute, second);
+		std::time_t results[] = {
+			calendar.NextDaily(now, hour, minute, second),
+			calendar.NextWeekly(now, week, hour, minute, second),
+			calendar.NextDate(now, month, date, hour, minute, second),
+		};
+		CronSpec const* specs[] = {&daily, &weekly, &yearly};
+		for (int i = 0; i < 3; ++i, ++total) {
+			if (!results[i]) {
+				continue;
+			}
+			std::time_t expect = now;
+			ASSERT_TRUE(specs[i]->FindNext(expect));
+			ASSERT_EQ(expect, results[i]) << "kind " << i << " at " << now;
+			++fast;
+		}
+	}
+	// targets past the next dst switch and days missing in a month take the full search
+	ASSERT_GT(fast, total * 2 / 3);
+	ASSERT_EQ(0, calendar.NextDaily(MakeTime(2018, 5, 7, 12, 0, 0), 24, 0, 0));
+	ASSERT_EQ(0, calendar.NextDate(MakeTime(2018, 5, 7, 12, 0, 0), 2, 30, 0, 0, 0));
+
+	if (tz) {
+		setenv("TZ", oldTz.c_str(), 1);
+	} else {
+		unsetenv("TZ");
+	}
+	tzset();
+}
+
+CronSpec RandomSpec(std::mt19937& rng) {
+	const char* exprs[] = {
+		"* * * * * *",
+		"0 */5 * * * *",
+		"0 0 9-17 * * 1-5",
+		"0 0 0 1 */3 *",
+		"0 30 8 13 * 5",
+		"0 0 0 29 2 *",
+		"0 0 0 29 2 1",
+		"0 0 12 * * * 2017",
+		"59 59 23 31 12 * 2099",
+	};
+	CronSpec spec;
+	auto n = rng() % 12;
+	if (n < sizeof(exprs) / sizeof(exprs[0])) {
+		TryParseCron(exprs[n], std::strlen(exprs[n]), spec);
+		return spec;
+	}
+	// sparse random masks, empty and infeasible ones included
+	spec.SetAll();
+	spec.Second().Clear().SetSingle(rng() % 60);
+	spec.Minute().Clear().SetSingle(rng() % 60).SetSingle(rng() % 60);
+	spec.Hour().Clear().SetRange(rng() % 24, rng() % 24 + 3);
+	if (rng() % 2) {
+		spec.DayOfMonth().Clear().SetSingle(rng() % 32);
+	}
+	if (rng() % 2) {
+		spec.DayOfWeek().Clear().SetSingle(rng() % 7);
+	}
+	if (rng() % 3 == 0) {
+		spec.Month().Clear().SetSingle(rng() % 12 + 1);
+	}
+	return spec;
+}
+
+TEST(CronSpecSet, MatchesFindNext) {
+	std::mt19937 rng(217);
+	CronSpecSet set;
+	for (int i = 0; i < 2000; ++i) {
+		set.Add(RandomSpec(rng));
+	}
+	ASSERT_EQ(2000, set.Size());
+	std::time_t refs[] = {
+		MakeTime(2018, 5, 7, 12, 0, 0),
+		MakeTime(2018, 12, 31, 23, 59, 59),
+		MakeTime(2020, 2, 28, 23, 30, 0),
+		MakeTime(2019, 3, 31, 1, 59, 59),
+	};
+	std::vector<std::time_t> next;
+	for (auto ref : refs) {
+		set.FindNext(ref, next);
+		ASSERT_EQ(set.Size(), next.size());
+		for (std::size_t i = 0; i < set.Size(); ++i) {
+			std::time_t expect = ref;
+			if (!set.Get(i).FindNext(expect)) {
+				expect = 0;
+			}
+			ASSERT_EQ(expect, next[i]) << "spec " << i << " at " << ref;
+		}
+	}
+
+	CronSpec hourly;
+	TryParseCron("0 0 * * * *", 11, hourly);
+	set.Set(0, hourly);
+	ASSERT_TRUE(set.Get(0) == hourly);
+	set.FindNext(MakeTime(2018, 5, 7, 12, 0, 0), next);
+	ASSERT_EQ(MakeTime(2018, 5, 7, 13, 0, 0), next[0]);
+	set.Clear();
+	set.FindNext(MakeTime(2018, 5, 7, 12, 0, 0), next);
+	ASSERT_TRUE(next.empty());
+}
+
+TEST(CronSpecSet, BenchFindNext) {
+	std::mt19937 rng(217);
+	CronSpecSet set;
+	std::vector<CronSpec> specs;
+	for (int i = 0; i < 100000; ++i) {
+		specs.push_back(RandomSpec(rng));
+		set.Add(specs.back());
+	}
+	const std::time_t now = MakeTime(2018, 5, 7, 12, 0, 0);
+	std::vector<std::time_t> bulk, single(specs.size());
+
+	auto begin = std::chrono::steady_clock::now();
+	set.FindNext(now, bulk);
+	auto bulkNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+
+	begin = std::chrono::steady_clock::now();
+	for (std::size_t i = 0; i < specs.size(); ++i) {
+		std::time_t t = now;
+		single[i] = specs[i].FindNext(t) ? t : 0;
+	}
+	auto singleNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+
+	ASSERT_EQ(single, bulk);
+	std::cout << "bulk: " << bulkNs / specs.size() << " ns per spec, one by one: "
+		<< singleNs / specs.size() << " ns per spec" << std::endl;
+}
\ No newline at end of file
@@ -0,0 +1,146 @@
+#include "gtest/gtest.h"
+#include <atomic>
+#include <thread>
+#include "Scheduler.hpp"
+#include "SchedulerGroup.hpp"
+#include "TreeJobContainer.hpp"
+#include "TestClock.hpp"
+
+using namespace elapse;
+
+TEST(JobJournal, MirrorsScheduler) {
+	auto clock = std::make_shared<ManualClock>();
+	Scheduler<int> s(clock, std::make_shared<TreeJobContainer>());
+	s.ScheduleLambda(1, clock->Now() + 100, [](JobId) {});
+	auto journal = std::make_shared<JobJournal<int>>();
+	s.SetJournal(journal);
+	JobSnapshot<int> snapshot(journal);
+	snapshot.Refresh();
+	ASSERT_EQ(1, snapshot.Size());
+	ASSERT_EQ(clock->Now() + 100, snapshot.Expire(1));
+
+	auto start = clock->Now();
+	size_t counter = 0;
+	for (int i = 2; i <= 10; ++i) {
+		s.ScheduleLambda(i, start + i * 10, [&counter](JobId) { ++counter; }, i % 2);
+	}
+	s.ScheduleRepeatLambda(20, crontab::Cycle(30, -1), [&counter](JobId) { ++counter; });
+	s.ScheduleNextTick(21, WrapLambdaPtr([&counter](JobId) { ++counter; }));
+	s.Reschedule(2, start + 200);
+	s.Cancel(3);
+	s.CancelGroup(1);
+	// nothing is published before the tick
+	snapshot.Refresh();
+	ASSERT_EQ(1, snapshot.Size());
+
+	s.Advance(45);
+	s.Tick();
+	snapshot.Refresh();
+	// SetJournal published the initial jobs
+	ASSERT_EQ(2, snapshot.Publishes());
+	ASSERT_EQ(s.Jobs().size(), snapshot.Size());
+	for (auto const& job : s.Jobs()) {
+		ASSERT_NE(0, snapshot.Expire(job.alias_));
+	}
+	ASSERT_EQ(start + 200, snapshot.Expire(2));
+	ASSERT_EQ(0, snapshot.Expire(4));
+	// re-armed from the tick time
+	ASSERT_EQ(start + 75, snapshot.Expire(20));
+	ASSERT_EQ(0, snapshot.Expire(21));
+
+	s.CancelAll();
+	s.Tick();
+	snapshot.Refresh();
+	ASSERT_EQ(0, snapshot.Size());
+
+	// detached schedulers no longer log
+	s.SetJournal(nullptr);
+	s.ScheduleLambda(1, clock->Now() + 100, [](JobId) {});
+	s.Tick();
+	ASSERT_EQ(0, snapshot.Refresh());
+}
+
+TEST(JobJournal, ReaderThread) {
+	Scheduler<int> s(std::make_shared<ManualClock>(), std::make_shared<TreeJobContainer>());
+	auto journal = std::make_shared<JobJournal<int>>();
+	s.SetJournal(journal);
+	const int kWindow = 50;
+
+	std::atomic<bool> stop(false);
+	size_t nInconsistent = 0;
+	JobSnapshot<int> snapshot(journal);
+	std::thread reader([&]() {
+		while (!stop) {
+			snapshot.Refresh();
+			// past the initial publish of SetJournal, every tick ends with kWindow jobs
+			if (snapshot.Publishes() > 1 && snapshot.Size() != kWindow) {
+				++nInconsistent;
+			}
+		}
+	});
+	for (int i = 0; i < 2000; ++i) {
+		s.ScheduleWithDelayLambda(i, 1000, [](JobId) {});
+		s.ScheduleWithDelayLambda(i + 1000000, 1000, [](JobId) {});
+		if (i >= kWindow) {
+			s.Cancel(i - kWindow);
+		}
+		s.Cancel(i + 1000000);
+		s.Advance(1);
+		if (i + 1 >= kWindow) {
+			s.Tick();
+		}
+	}
+	stop = true;
+	reader.join();
+	// the last publish may have met a busy reader
+	s.Tick();
+	snapshot.Refresh();
+	ASSERT_EQ(0, nInconsistent);
+	ASSERT_EQ(kWindow, snapshot.Size());
+	for (auto const& job : s.Jobs()) {
+		ASSERT_NE(0, snapshot.Expire(job.alias_));
+	}
+}
+
+TEST(JobJournal, DestroyInTick) {
+	auto scheduler = std::make_shared<Scheduler<int>>(new TreeJobContainer());
+	auto journal = std::make_shared<JobJournal<int>>();
+	scheduler->SetJournal(journal);
+	JobSnapshot<int> snapshot(journal);
+	scheduler->ScheduleWithDelayLambda(1, 1, [&scheduler](JobId id) {
+		scheduler.reset();
+	});
+	scheduler->ScheduleWithDelayLambda(2, 100, [](JobId id) {});
+	scheduler->Advance(1); scheduler->Tick();
+	ASSERT_FALSE(scheduler);
+	// the tick still publishes what the destroyed scheduler logged
+	snapshot.Refresh();
+	ASSERT_EQ(0, snapshot.Size());
+	ASSERT_EQ(2, snapshot.Publishes());
+}
+
+TEST(JobJournal, IdleGroupMember) {
+	auto clock = std::make_shared<ManualClock>();
+	SchedulerGroup group(clock);
+	Scheduler<int> s(clock, std::make_shared<TreeJobContainer>());
+	group.Add(s);
+	auto journal = std::make_shared<JobJournal<int>>();
+	s.SetJournal(journal);
+	JobSnapshot<int> snapshot(journal);
+
+	// nothing is due, unpublished changes still ask for a tick
+	s.ScheduleWithDelayLambda(1, 1000, [](JobId) {});
+	ASSERT_EQ(clock->Now(), s.NextDeadline());
+	ASSERT_EQ(clock->Now(), group.NextDeadline());
+	ASSERT_EQ(1, group.Tick());
+	snapshot.Refresh();
+	ASSERT_EQ(clock->Now() + 1000, snapshot.Expire(1));
+	ASSERT_EQ(clock->Now() + 1000, group.NextDeadline());
+	ASSERT_EQ(0, group.Tick());
+
+	s.Cancel(1);
+	ASSERT_EQ(1, group.Tick());
+	snapshot.Refresh();
+	ASSERT_EQ(0, snapshot.Size());
+	ASSERT_EQ(SchedulerGroup::NoDeadline, group.NextDeadline());
+}
\ No newline at end of file
@@ -0,0 +1,125 @@
+#include "gtest/gtest.h"
+#include <vector>
+#include "Scheduler.hpp"
+#include "SchedulerGroup.hpp"
+#include "TreeJobContainer.hpp"
+#include "TestClock.hpp"
+
+using namespace elapse;
+
+class CountingScheduler : public Scheduler<int> {
+public:
+	CountingScheduler(std::shared_ptr<Clock> clock) :
+		Scheduler<int>(clock, std::make_shared<TreeJobContainer>()),
+		ticks_(0) {}
+
+	virtual void Tick() override {
+		++ticks_;
+		Scheduler<int>::Tick();
+	}
+
+	size_t ticks_;
+};
+
+TEST(SchedulerGroup, TickDueOnly) {
+	auto clock = std::make_shared<ManualClock>();
+	SchedulerGroup group(clock);
+	std::vector<std::unique_ptr<CountingScheduler>> members;
+	size_t counter = 0;
+	for (int i = 0; i < 100; ++i) {
+		members.emplace_back(new CountingScheduler(clock));
+		group.Add(*members.back());
+	}
+	ASSERT_EQ(100, group.Size());
+	ASSERT_EQ(SchedulerGroup::NoDeadline, group.NextDeadline());
+
+	// joined members report deadlines when jobs are scheduled
+	for (int i = 0; i < 10; ++i) {
+		members[i * 10]->ScheduleWithDelayLambda(1, (i + 1) * 10, [&counter](JobId id) { ++counter; });
+	}
+	ASSERT_EQ(clock->Now() + 10, group.NextDeadline());
+
+	for (int i = 0; i < 10; ++i) {
+		clock->Advance(10);
+		ASSERT_EQ(1, group.Tick());
+		ASSERT_EQ(i + 1, counter);
+	}
+	for (auto const& member : members) {
+		ASSERT_LE(member->ticks_, 1);
+	}
+	clock->Advance(1000);
+	ASSERT_EQ(0, group.Tick());
+}
+
+TEST(SchedulerGroup, RepeatAndCancel) {
+	auto clock = std::make_shared<ManualClock>();
+	SchedulerGroup group(clock);
+	CountingScheduler a(clock), b(clock);
+	size_t counter = 0;
+	a.ScheduleRepeatLambda(1, crontab::Cycle(10, -1), [&counter](JobId id) { ++counter; });
+	group.Add(a);
+	group.Add(b);
+	b.ScheduleWithDelayLambda(1, 5, [](JobId id) {});
+	b.Cancel(1);
+
+	// stale deadline of b costs a single spurious tick
+	clock->Advance(5);
+	ASSERT_EQ(1, group.Tick());
+	ASSERT_EQ(1, b.ticks_);
+	for (int i = 0; i < 10; ++i) {
+		clock->Advance(5);
+		group.Tick();
+	}
+	ASSERT_EQ(5, counter);
+	ASSERT_EQ(5, a.ticks_);
+	ASSERT_EQ(1, b.ticks_);
+
+	ASSERT_TRUE(group.Remove(a));
+	ASSERT_FALSE(group.Remove(a));
+	clock->Advance(100);
+	ASSERT_EQ(0, group.Tick());
+	ASSERT_EQ(5, counter);
+}
+
+TEST(SchedulerGroup, DestroyMemberInCB) {
+	auto clock = std::make_shared<ManualClock>();
+	SchedulerGroup group(clock);
+	std::unique_ptr<CountingScheduler> a(new CountingScheduler(clock)), b(new CountingScheduler(clock));
+	group.Add(*a);
+	group.Add(*b);
+	a->ScheduleWithDelayLambda(1, 10, [&b](JobId id) { b.reset(); });
+	b->ScheduleWithDelayLambda(1, 10, [](JobId id) { FAIL(); });
+	a->ScheduleWithDelayLambda(2, 20, [&a](JobId id) { a.reset(); });
+
+	clock->Advance(10);
+	group.Tick();
+	ASSERT_FALSE(b);
+	ASSERT_EQ(1, group.Size());
+	clock->Advance(10);
+	group.Tick();
+	ASSERT_FALSE(a);
+	ASSERT_EQ(0, group.Size());
+}
+
+TEST(SchedulerGroup, PausedDomain) {
+	auto clock = std::make_shared<ManualClock>();
+	auto domain = std::make_shared<DomainClock>(clock);
+	SchedulerGroup group(clock);
+	CountingScheduler s(domain);
+	group.Add(s);
+	size_t counter = 0;
+	s.ScheduleWithDelayLambda(1, 10, [&counter](JobId id) { ++counter; });
+
+	domain->Pause();
+	clock->Advance(10);
+	group.Tick();
+	ASSERT_EQ(0, counter);
+	ASSERT_EQ(SchedulerGroup::NoDeadline, group.NextDeadline());
+
+	domain->Resume();
+	s.RefreshDeadline();
+	ASSERT_EQ(clock->Now() + 10, group.NextDeadline());
+	clock->Advance(10);
+	group.Tick();
+	ASSERT_EQ(1, counter);
+}
@@ -1,7 +1,12 @@
 #include "gtest/gtest.h"
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
 #include <list>
+#include <stdexcept>
 #include "Scheduler.hpp"
 #include "TreeJobContainer.hpp"
+#include "TestClock.hpp"
 
 using namespace elapse;
 
@@ -249,6 +254,738 @@ TEST(Scheduler, CycleScheduleAndCancel) {
 	ASSERT_EQ(5, counter);
 }
 
+TEST(Scheduler, CycleValueSchedule) {
+	Scheduler<int> s(std::make_shared<ManualClock>(), std::make_shared<TreeJobContainer>());
+	size_t counter = 0;
+	crontab::Cycle cycle(100, 10);
+
+	s.ScheduleRepeatLambda(1, cycle, [&counter](JobId id) {
+		++counter;
+	});
+	JobId firstId = s.Jobs().find(1)->id_;
+
+	for (int i = 0; i < 10; ++i) {
+		s.Advance(98); s.Tick();
+		ASSERT_EQ(i, counter);
+		s.Advance(2); s.Tick();
+		ASSERT_EQ(i + 1, counter);
+		if (i < 9) {
+			// re-armed in-place
+			ASSERT_EQ(firstId, s.Jobs().find(1)->id_);
+		}
+	}
+	s.Advance(10000); s.Tick();
+	ASSERT_EQ(10, counter);
+	ASSERT_FALSE(s.HasCallback(1));
+	ASSERT_EQ(0, s.Container().Size());
+}
+
+// user defined repeat config, fires at every multiple of its step
+class StepRepeat {
+public:
+	explicit StepRepeat(TimeUnit step) : step_(step) {}
+
+	TimeUnit NextExpire(Clock const& clock) { return (clock.Now() / step_ + 1) * step_; }
+	TimeUnit Period() const { return step_; }
+
+private:
+	TimeUnit step_;
+};
+
+TEST(Scheduler, UserRepeatValueSchedule) {
+	typedef boost::variant<boost::blank, crontab::Cycle, StepRepeat> MyRepeat;
+	Scheduler<int, std::hash<int>, MyRepeat> s(std::make_shared<ManualClock>(), std::make_shared<TreeJobContainer>());
+	size_t counter = 0;
+
+	s.ScheduleRepeatLambda(1, StepRepeat(1000), [&counter](JobId id) {
+		++counter;
+	});
+	for (int i = 0; i < 10; ++i) {
+		s.Advance(1000); s.Tick();
+		ASSERT_EQ(i + 1, counter);
+	}
+	s.Cancel(1);
+	s.Advance(1000); s.Tick();
+	ASSERT_EQ(10, counter);
+}
+
+TEST(Scheduler, CyclePhaseSpreadEven) {
+	Scheduler<int> s(std::make_shared<ManualClock>(), std::make_shared<TreeJobContainer>());
+	const int nJobs = 1000;
+	const TimeUnit period = 100;
+	size_t counter = 0;
+	for (int i = 0; i < nJobs; ++i) {
+		s.ScheduleRepeatLambda(i, std::make_shared<crontab::Cycle>(period, -1), [&counter](JobId id) {
+			++counter;
+		}, PhaseSpread::Even);
+	}
+
+	size_t maxPerTick = 0, total = 0;
+	for (TimeUnit t = 0; t < period; ++t) {
+		counter = 0;
+		s.Advance(1); s.Tick();
+		maxPerTick = std::max(maxPerTick, counter);
+		total += counter;
+	}
+	ASSERT_EQ(nJobs, total);
+	ASSERT_LE(maxPerTick, 2 * nJobs / period);
+}
+
+TEST(Scheduler, CyclePhaseSpreadByAlias) {
+	Scheduler<std::string> s1(std::make_shared<ManualClock>(), std::make_shared<TreeJobContainer>());
+	Scheduler<std::string> s2(std::make_shared<ManualClock>(), std::make_shared<TreeJobContainer>());
+	TimeUnit firstFire1 = 0, firstFire2 = 0;
+	s1.ScheduleRepeatLambda("foo", std::make_shared<crontab::Cycle>(1000, 2), [&firstFire1](JobId id) {
+		if (!firstFire1) firstFire1 = 1;
+	}, PhaseSpread::ByAlias);
+	s2.ScheduleRepeatLambda("foo", std::make_shared<crontab::Cycle>(1000, 2), [&firstFire2](JobId id) {
+		if (!firstFire2) firstFire2 = 1;
+	}, PhaseSpread::ByAlias);
+
+	for (TimeUnit t = 1; t <= 1000 && !firstFire1; ++t) {
+		s1.Advance(1); s1.Tick();
+		s2.Advance(1); s2.Tick();
+		ASSERT_EQ(firstFire1, firstFire2);
+	}
+	ASSERT_EQ(1, firstFire1);
+}
+
+TEST(Scheduler, GroupCancel) {
+	Scheduler<int> s(std::make_shared<ManualClock>(), std::make_shared<TreeJobContainer>());
+	size_t counter = 0;
+	for (int i = 0; i < 30; ++i) {
+		s.ScheduleWithDelayLambda(i, 100, [&counter](JobId id) { ++counter; }, i % 3);
+	}
+	s.ScheduleRepeatLambda(100, crontab::Cycle(10, -1), [&counter](JobId id) { ++counter; },
+		PhaseSpread::None, 2);
+
+	ASSERT_EQ(10, s.CountGroup(NullGroup));
+	ASSERT_EQ(10, s.CountGroup(1));
+	ASSERT_EQ(11, s.CountGroup(2));
+	ASSERT_EQ(10, s.Container().CountGroup(1));
+
+	std::vector<int> aliases;
+	s.IterGroup(1, [&aliases](int alias) { aliases.push_back(alias); return true; });
+	std::sort(aliases.begin(), aliases.end());
+	ASSERT_EQ(10, aliases.size());
+	ASSERT_EQ(1, aliases.front());
+	ASSERT_EQ(28, aliases.back());
+
+	ASSERT_EQ(11, s.CancelGroup(2));
+	ASSERT_EQ(0, s.CountGroup(2));
+	ASSERT_EQ(0, s.Container().CountGroup(2));
+	ASSERT_FALSE(s.HasCallback(2));
+	ASSERT_FALSE(s.HasCallback(100));
+
+	// moving an alias into another group
+	s.ScheduleWithDelayLambda(1, 100, [&counter](JobId id) { ++counter; }, 3);
+	ASSERT_EQ(9, s.CountGroup(1));
+	ASSERT_EQ(1, s.CountGroup(3));
+
+	s.Advance(100); s.Tick();
+	ASSERT_EQ(20, counter);
+}
+
+TEST(Scheduler, GroupCancelInRepeatCB) {
+	Scheduler<int> s(std::make_shared<ManualClock>(), std::make_shared<TreeJobContainer>());
+	size_t counter = 0;
+	for (int i = 0; i < 5; ++i) {
+		s.ScheduleRepeatLambda(i, crontab::Cycle(10, -1), [&s, &counter](JobId id) {
+			++counter;
+			s.CancelGroup(7);
+		}, PhaseSpread::None, 7);
+	}
+	s.Advance(10); s.Tick();
+	ASSERT_EQ(1, counter);
+	ASSERT_EQ(0, s.CountGroup(7));
+	ASSERT_EQ(0, s.Container().Size());
+	s.Advance(10); s.Tick();
+	ASSERT_EQ(1, counter);
+}
+
+TEST(Scheduler, DomainClockPauseAndRate) {
+	auto base = std::make_shared<ManualClock>();
+	auto domain = std::make_shared<DomainClock>(base);
+	Scheduler<int> s(domain, std::make_shared<TreeJobContainer>());
+	size_t counter = 0;
+	for (int i = 0; i < 10; ++i) {
+		s.ScheduleWithDelayLambda(i, (i + 1) * 100, [&counter](JobId id) { ++counter; });
+	}
+
+	base->Advance(100); s.Tick();
+	ASSERT_EQ(1, counter);
+
+	// paused domains keep their jobs untouched
+	domain->Pause();
+	ASSERT_EQ(std::numeric_limits<TimeUnit>::max(), domain->ToBaseTime(domain->Now() + 1));
+	base->Advance(1000); s.Tick();
+	ASSERT_EQ(1, counter);
+	domain->Resume();
+	ASSERT_EQ(base->Now() + 100, domain->ToBaseTime(domain->Now() + 100));
+	base->Advance(100); s.Tick();
+	ASSERT_EQ(2, counter);
+
+	// double speed
+	domain->SetRate(2.0);
+	ASSERT_EQ(base->Now() + 50, domain->ToBaseTime(domain->Now() + 100));
+	base->Advance(50); s.Tick();
+	ASSERT_EQ(3, counter);
+	base->Advance(150); s.Tick();
+	ASSERT_EQ(6, counter);
+
+	// domain advance only shifts the domain
+	domain->SetRate(1.0);
+	domain->Advance(400); s.Tick();
+	ASSERT_EQ(10, counter);
+
+	// negative rates freeze the domain
+	auto now = domain->Now();
+	domain->SetRate(-2.0);
+	ASSERT_EQ(0.0, domain->Rate());
+	base->Advance(100);
+	ASSERT_EQ(now, domain->Now());
+	ASSERT_EQ(std::numeric_limits<TimeUnit>::max(), domain->ToBaseTime(now + 1));
+	DomainClock reversed(base, -1.0);
+	base->Advance(100);
+	ASSERT_EQ(base->Now() - 100, reversed.Now());
+}
+
+TEST(Scheduler, TimeResolution) {
+	static_assert(ToTimeUnit(std::chrono::seconds(1)) == kTimeUnitsPerSecond, "one second");
+	ASSERT_EQ(2 * kTimeUnitsPerSecond, ToTimeUnit(std::time_t(2)));
+	Clock wall;
+	ASSERT_NEAR(static_cast<double>(wall.NowTimeT()), static_cast<double>(wall.Now() / kTimeUnitsPerSecond), 1.0);
+
+	auto clock = std::make_shared<ManualClock>();
+	ASSERT_EQ(clock->NowTimeT(), std::chrono::system_clock::to_time_t(clock->TimePoint()));
+	Scheduler<int> s(clock, std::make_shared<TreeJobContainer>());
+	// one time unit in millisecond builds, 250us with a finer resolution
+	auto step = std::max<TimeUnit>(1, ToTimeUnit(std::chrono::microseconds(250)));
+	size_t counter = 0;
+	s.ScheduleRepeatLambda(1, crontab::Cycle(step, 4), [&counter](JobId id) { ++counter; });
+	for (size_t i = 0; i < 4; ++i) {
+		if (step > 1) {
+			clock->Advance(step - 1); s.Tick();
+			ASSERT_EQ(i, counter);
+			clock->Advance(1); s.Tick();
+		} else {
+			clock->Advance(step); s.Tick();
+		}
+		ASSERT_EQ(i + 1, counter);
+	}
+	ASSERT_FALSE(s.HasCallback(1));
+}
+
+TEST(Scheduler, ScheduleMany) {
+	auto clock = std::make_shared<ManualClock>();
+	Scheduler<int> s(clock, std::make_shared<TreeJobContainer>());
+	size_t counter = 0;
+	s.ScheduleWithDelayLambda(1, 1000, [&counter](JobId id) { counter += 100; });
+	std::vector<Scheduler<int>::item_type> items;
+	for (int i = 0; i < 100; ++i) {
+		items.emplace_back(i, 100 - i, WrapLambdaPtr([&counter](JobId id) { ++counter; }), i % 2 ? 2 : NullGroup);
+	}
+	s.ScheduleManyWithDelay(std::move(items));
+	// alias 1 was replaced by the batch
+	ASSERT_EQ(100, s.Jobs().size());
+	ASSERT_EQ(100, s.Container().Size());
+	ASSERT_EQ(50, s.CountGroup(2));
+	ASSERT_EQ(3, s.CancelMany({0, 2, 3, 1000}));
+	ASSERT_EQ(97, s.Container().Size());
+	clock->Advance(50); s.Tick();
+	ASSERT_EQ(50, counter);
+	clock->Advance(1000); s.Tick();
+	ASSERT_EQ(97, counter);
+	ASSERT_EQ(0, s.Jobs().size());
+
+	items.clear();
+	items.emplace_back(7, clock->Now() - 10, WrapLambdaPtr([&counter](JobId id) { ++counter; }));
+	items.emplace_back(7, clock->Now() + 10, WrapLambdaPtr([&counter](JobId id) { counter += 10; }));
+	s.ScheduleMany(std::move(items));
+	ASSERT_EQ(1, s.Container().Size());
+	clock->Advance(10); s.Tick();
+	ASSERT_EQ(107, counter);
+}
+
+class AliasSink : public BatchAliasCallback<int> {
+public:
+	virtual void operator()(int const* aliases, size_t count) override {
+		calls_.emplace_back(aliases, aliases + count);
+	}
+
+	std::vector<std::vector<int>> calls_;
+};
+
+TEST(Scheduler, ScheduleBatched) {
+	auto clock = std::make_shared<ManualClock>();
+	Scheduler<int> s(clock, std::make_shared<TreeJobContainer>());
+	AliasSink sink;
+	for (int i = 0; i < 10; ++i) {
+		s.ScheduleBatched(i, clock->Now() + 10 + i / 5 * 10, &sink);
+	}
+	s.Cancel(1);
+	s.ScheduleWithDelayLambda(2, 5, [](JobId id) {});
+	s.ScheduleBatched(3, clock->Now() + 20, &sink);
+	clock->Advance(10); s.Tick();
+	ASSERT_EQ(1, sink.calls_.size());
+	ASSERT_EQ((std::vector<int>{0, 4}), sink.calls_[0]);
+	ASSERT_EQ(6, s.Jobs().size());
+	clock->Advance(10); s.Tick();
+	ASSERT_EQ(2, sink.calls_.size());
+	std::sort(sink.calls_[1].begin(), sink.calls_[1].end());
+	ASSERT_EQ((std::vector<int>{3, 5, 6, 7, 8, 9}), sink.calls_[1]);
+	ASSERT_EQ(0, s.Jobs().size());
+}
+
+TEST(Scheduler, RemoveSink) {
+	auto clock = std::make_shared<ManualClock>();
+	Scheduler<int> s(clock, std::make_shared<TreeJobContainer>());
+	AliasSink kept, removed;
+	for (int i = 0; i < 6; ++i) {
+		s.ScheduleBatched(i, clock->Now() + 10, i % 2 ? &removed : &kept);
+	}
+	ASSERT_EQ(3, s.RemoveSink(&removed));
+	ASSERT_EQ(0, s.RemoveSink(&removed));
+	ASSERT_EQ(3, s.Jobs().size());
+	ASSERT_EQ(3, s.Container().Size());
+	clock->Advance(10); s.Tick();
+	ASSERT_EQ(1, kept.calls_.size());
+	ASSERT_TRUE(removed.calls_.empty());
+
+	// a sink removing itself from its own call
+	class OneShotSink : public BatchAliasCallback<int> {
+	public:
+		explicit OneShotSink(Scheduler<int>& s) : s_(s), count_(0) {}
+		virtual void operator()(int const* aliases, size_t count) override {
+			count_ += count;
+			s_.RemoveSink(this);
+		}
+
+		Scheduler<int>& s_;
+		size_t count_;
+	} oneShot(s);
+	s.ScheduleBatched(1, clock->Now() + 10, &oneShot);
+	s.ScheduleBatched(2, clock->Now() + 20, &oneShot);
+	clock->Advance(10); s.Tick();
+	ASSERT_EQ(1, oneShot.count_);
+	ASSERT_EQ(0, s.Jobs().size());
+	ASSERT_EQ(0, s.Container().Size());
+	clock->Advance(10); s.Tick();
+	ASSERT_EQ(1, oneShot.count_);
+}
+
+TEST(Scheduler, DestroyWithPendingBatch) {
+	auto clock = std::make_shared<ManualClock>();
+	auto container = std::make_shared<TreeJobContainer>();
+	auto s = std::make_shared<Scheduler<int>>(clock, container);
+	AliasSink sink;
+	s->ScheduleBatched(1, clock->Now() + 5, &sink);
+	s->ScheduleWithDelayLambda(2, 10, [&s](JobId) { s.reset(); });
+	clock->Advance(10);
+	// the batched id is collected before the scheduler goes, its sink must not be flushed
+	container->PopExpires(clock->Now());
+	ASSERT_FALSE(s);
+	ASSERT_TRUE(sink.calls_.empty());
+	ASSERT_EQ(0, container->Size());
+}
+
+TEST(Scheduler, Handle) {
+	auto clock = std::make_shared<ManualClock>();
+	Scheduler<int> s(clock, std::make_shared<TreeJobContainer>());
+	size_t counter = 0;
+	auto h1 = s.ScheduleHandle(1, clock->Now() + 10, WrapLambdaPtr([&counter](JobId id) { ++counter; }));
+	auto h2 = s.ScheduleHandle(2, clock->Now() + 10, WrapLambdaPtr([&counter](JobId id) { counter += 10; }));
+	s.ScheduleRepeatLambda(3, crontab::Cycle(10, -1), [&counter](JobId id) { counter += 100; });
+	auto h3 = s.Handle(3);
+	ASSERT_NE(h1, h2);
+	ASSERT_EQ(h3, s.Handle(3));
+	ASSERT_FALSE(s.IsValid(JobHandle()));
+	ASSERT_FALSE(s.IsValid(s.Handle(4)));
+
+	ASSERT_TRUE(s.Reschedule(h2, clock->Now() + 30));
+	clock->Advance(10); s.Tick();
+	ASSERT_EQ(101, counter);
+	// fired calls invalidate their handles
+	ASSERT_FALSE(s.IsValid(h1));
+	ASSERT_FALSE(s.Cancel(h1));
+	ASSERT_FALSE(s.Reschedule(h1, clock->Now() + 10));
+	ASSERT_TRUE(s.IsValid(h3));
+	ASSERT_TRUE(s.Reschedule(h3, clock->Now() + 15));
+	clock->Advance(10); s.Tick();
+	ASSERT_EQ(101, counter);
+	clock->Advance(5); s.Tick();
+	ASSERT_EQ(201, counter);
+
+	// the slot of h1 is reused with a new generation
+	auto h4 = s.ScheduleHandle(4, clock->Now() + 10, WrapLambdaPtr([&counter](JobId id) { ++counter; }));
+	ASSERT_EQ(h1.slot_, h4.slot_);
+	ASSERT_FALSE(s.IsValid(h1));
+	// replacing an alias invalidates its handle
+	s.ScheduleWithDelayLambda(4, 10, [](JobId id) {});
+	ASSERT_FALSE(s.IsValid(h4));
+
+	ASSERT_TRUE(s.Cancel(h3));
+	ASSERT_FALSE(s.HasCallback(3));
+	ASSERT_FALSE(s.Cancel(h3));
+	ASSERT_TRUE(s.IsValid(h2));
+	s.CancelAll();
+	ASSERT_FALSE(s.IsValid(h2));
+	clock->Advance(100); s.Tick();
+	ASSERT_EQ(201, counter);
+}
+
+TEST(Scheduler, ScheduleNextTick) {
+	auto clock = std::make_shared<ManualClock>();
+	Scheduler<int> s(clock, std::make_shared<TreeJobContainer>());
+	std::vector<int> fired;
+	s.ScheduleWithDelayLambda(0, 1, [&fired](JobId id) { fired.push_back(0); });
+	for (int i = 1; i <= 3; ++i) {
+		s.ScheduleWithDelayLambda(i, 0, [&fired, &s, i](JobId id) {
+			fired.push_back(i);
+			s.ScheduleWithDelayLambda(i, 0, [&fired, i](JobId id) { fired.push_back(i * 10); });
+		});
+	}
+	s.Cancel(2);
+	ASSERT_EQ(3, s.Container().Size());
+	// immediate jobs run without advancing the clock
+	s.Tick();
+	ASSERT_EQ((std::vector<int>{1, 3}), fired);
+	ASSERT_TRUE(s.HasCallback(1));
+	clock->Advance(1); s.Tick();
+	ASSERT_EQ((std::vector<int>{1, 3, 10, 30, 0}), fired);
+	ASSERT_EQ(0, s.Jobs().size());
+}
+
+TEST(Scheduler, RescheduleNextTick) {
+	auto clock = std::make_shared<ManualClock>();
+	Scheduler<int> s(clock, std::make_shared<TreeJobContainer>());
+	size_t counter = 0;
+	s.ScheduleWithDelayLambda(1, 0, [&counter](JobId id) { ++counter; });
+	ASSERT_TRUE(s.Reschedule(1, clock->Now() + 100));
+	ASSERT_EQ(1, s.Container().Size());
+	s.Tick();
+	clock->Advance(99); s.Tick();
+	ASSERT_EQ(0, counter);
+	ASSERT_TRUE(s.HasCallback(1));
+	clock->Advance(1); s.Tick();
+	ASSERT_EQ(1, counter);
+	ASSERT_EQ(0, s.Jobs().size());
+	ASSERT_EQ(0, s.Container().Size());
+}
+
+TEST(Scheduler, HeterogeneousLookup) {
+	auto clock = std::make_shared<ManualClock>();
+	Scheduler<std::string, StringHash> s(clock, std::make_shared<TreeJobContainer>());
+	size_t counter = 0;
+	s.ScheduleWithDelayLambda("a", 10, [&counter](JobId id) { ++counter; });
+	s.ScheduleWithDelayLambda("b", 10, [&counter](JobId id) { ++counter; });
+	s.ScheduleRepeatLambda("c", crontab::Cycle(10, -1), [&counter](JobId id) { ++counter; });
+	boost::string_view a("a"), b("b"), c("c");
+	ASSERT_TRUE(s.HasCallback(a));
+	ASSERT_FALSE(s.HasCallback(boost::string_view("d")));
+	ASSERT_TRUE(s.Reschedule(b, clock->Now() + 20));
+	ASSERT_EQ(s.Handle(std::string("c")), s.Handle(c));
+	ASSERT_TRUE(s.Cancel(a));
+	ASSERT_FALSE(s.Cancel(a));
+	clock->Advance(10); s.Tick();
+	ASSERT_EQ(1, counter);
+	clock->Advance(10); s.Tick();
+	ASSERT_EQ(3, counter);
+	ASSERT_TRUE(s.Cancel(c));
+	ASSERT_EQ(0, s.Jobs().size());
+}
+
+TEST(Scheduler, ScheduleAt) {
+	auto clock = std::make_shared<ManualClock>();
+	Scheduler<int> s(clock, std::make_shared<TreeJobContainer>());
+	size_t counter = 0;
+	auto expect = [&clock](crontab::CronSpec const& spec) { return spec.NextExpire(*clock); };
+	crontab::CronSpec daily, weekly, yearly;
+	daily.Parse(4, 30, 0);
+	weekly.Parse(7, 4, 30, 0);
+	yearly.Parse(2, 29, 4, 30, 0);
+
+	s.ScheduleAtLambda(1, 4, 30, 0, [&counter](JobId id) { ++counter; });
+	ASSERT_EQ(expect(daily), s.Container().EarliestExpire());
+	s.CancelAll();
+	s.ScheduleWeeklyAtLambda(1, 7, 4, 30, 0, [&counter](JobId id) { ++counter; });
+	ASSERT_EQ(expect(weekly), s.Container().EarliestExpire());
+	s.CancelAll();
+	// leap day, beyond the fast path
+	s.ScheduleAtDateLambda(1, 2, 29, 4, 30, 0, [&counter](JobId id) { ++counter; });
+	ASSERT_EQ(expect(yearly), s.Container().EarliestExpire());
+	s.CancelAll();
+	// never fires
+	s.ScheduleAtDateLambda(1, 2, 30, 4, 30, 0, [&counter](JobId id) { ++counter; });
+	ASSERT_FALSE(s.HasCallback(1));
+
+	s.ScheduleAtLambda(1, 4, 30, 0, [&counter](JobId id) { ++counter; });
+	clock->Advance(expect(daily) - clock->Now()); s.Tick();
+	ASSERT_EQ(1, counter);
+}
+
+TEST(Scheduler, InvalidateCalendar) {
+	// fixed offset zones, restored afterwards
+	auto tz = std::getenv("TZ");
+	std::string oldTz = tz ? tz : "";
+	setenv("TZ", "UTC0", 1);
+	tzset();
+
+	auto clock = std::make_shared<ManualClock>();
+	Scheduler<int> s(clock, std::make_shared<TreeJobContainer>());
+	auto expect = [&clock](crontab::CronSpec const& spec) { return spec.NextExpire(*clock); };
+	crontab::CronSpec daily;
+	daily.Parse(4, 30, 0);
+	s.ScheduleAtLambda(1, 4, 30, 0, [](JobId id) {});
+	auto utc = expect(daily);
+	ASSERT_EQ(utc, s.Container().EarliestExpire());
+
+	// the cached offset outlives the TZ change until invalidated
+	setenv("TZ", "JST-9", 1);
+	tzset();
+	auto local = expect(daily);
+	ASSERT_NE(utc, local);
+	s.ScheduleAtLambda(1, 4, 30, 0, [](JobId id) {});
+	ASSERT_EQ(utc, s.Container().EarliestExpire());
+	s.InvalidateCalendar();
+	s.ScheduleAtLambda(1, 4, 30, 0, [](JobId id) {});
+	ASSERT_EQ(local, s.Container().EarliestExpire());
+
+	if (tz) {
+		setenv("TZ", oldTz.c_str(), 1);
+	} else {
+		unsetenv("TZ");
+	}
+	tzset();
+}
+
+class CountedCycle : public crontab::IRepeatable {
+public:
+	CountedCycle(TimeUnit delay, int repeats) : delay_(delay), repeats_(repeats), evaluations_(0) {}
+
+	TimeUnit NextExpire(Clock const& clock) override {
+		++evaluations_;
+		return repeats_-- > 0 ? clock.Now() + delay_ : 0;
+	}
+
+	TimeUnit delay_;
+	int repeats_;
+	size_t evaluations_;
+};
+
+TEST(Scheduler, SharedSchedule) {
+	auto clock = std::make_shared<ManualClock>();
+	Scheduler<int> s(clock, std::make_shared<TreeJobContainer>());
+	auto cycle = std::make_shared<CountedCycle>(10, 3);
+	size_t counter = 0;
+	for (int i = 0; i < 100; ++i) {
+		s.ScheduleSharedLambda(i, -1, crontab::RepeatablePtr(cycle), [&counter](JobId id) { ++counter; });
+	}
+	ASSERT_TRUE(s.HasSharedSchedule(-1));
+	ASSERT_EQ(100, s.Jobs().size());
+	ASSERT_EQ(1, s.Container().Size());
+	ASSERT_EQ(1, cycle->evaluations_);
+
+	clock->Advance(10); s.Tick();
+	ASSERT_EQ(100, counter);
+	ASSERT_EQ(2, cycle->evaluations_);
+
+	// a cancelled or replaced subscriber is left out
+	ASSERT_TRUE(s.Cancel(0));
+	ASSERT_FALSE(s.Reschedule(2, clock->Now() + 5));
+	size_t oneShot = 0;
+	s.ScheduleWithDelayLambda(1, 5, [&oneShot](JobId id) { ++oneShot; });
+	clock->Advance(10); s.Tick();
+	ASSERT_EQ(198, counter);
+	ASSERT_EQ(1, oneShot);
+	ASSERT_EQ(3, cycle->evaluations_);
+
+	// the finished schedule takes its subscribers along
+	clock->Advance(10); s.Tick();
+	ASSERT_EQ(296, counter);
+	ASSERT_EQ(4, cycle->evaluations_);
+	ASSERT_FALSE(s.HasSharedSchedule(-1));
+	ASSERT_EQ(0, s.Jobs().size());
+	ASSERT_EQ(0, s.Container().Size());
+
+	// subscribers joining from a callback wait for the next firing
+	counter = 0;
+	s.ScheduleSharedLambda(0, -2, crontab::Cycle(10, -1), [&s, &counter](JobId id) {
+		if (!counter++) {
+			s.ScheduleSharedLambda(1, -2, crontab::Cycle(10, -1), [&counter](JobId id) { counter += 10; });
+		}
+	});
+	clock->Advance(10); s.Tick();
+	ASSERT_EQ(1, counter);
+	clock->Advance(10); s.Tick();
+	ASSERT_EQ(12, counter);
+	s.CancelAll();
+	ASSERT_FALSE(s.HasSharedSchedule(-2));
+	ASSERT_EQ(0, s.Container().Size());
+}
+
+TEST(Scheduler, SharedScheduleCancel) {
+	auto clock = std::make_shared<ManualClock>();
+	Scheduler<int> s(clock, std::make_shared<TreeJobContainer>());
+	auto state = std::make_shared<int>(0);
+	for (int i = 0; i < 4; ++i) {
+		s.ScheduleSharedLambda(i, -1, crontab::Cycle(1000, -1), [state](JobId id) { ++*state; }, i < 2 ? 7 : NullGroup);
+	}
+	ASSERT_EQ(5, state.use_count());
+
+	// cancelled, grouped and replaced subscribers release their callbacks at once
+	ASSERT_TRUE(s.Cancel(0));
+	ASSERT_EQ(4, state.use_count());
+	ASSERT_EQ(1, s.CancelGroup(7));
+	ASSERT_EQ(3, state.use_count());
+	s.ScheduleWithDelayLambda(2, 10, [](JobId id) {});
+	ASSERT_EQ(2, state.use_count());
+	ASSERT_TRUE(s.HasSharedSchedule(-1));
+	ASSERT_EQ(2, s.Container().Size());
+
+	// the last one takes the schedule and its job along
+	ASSERT_TRUE(s.Cancel(3));
+	ASSERT_EQ(1, state.use_count());
+	ASSERT_FALSE(s.HasSharedSchedule(-1));
+	ASSERT_EQ(1, s.Jobs().size());
+	ASSERT_EQ(1, s.Container().Size());
+
+	// re-subscribing the only subscriber keeps the schedule
+	s.ScheduleSharedLambda(0, -2, crontab::Cycle(10, -1), [state](JobId id) { ++*state; });
+	s.ScheduleSharedLambda(0, -2, crontab::Cycle(10, -1), [state](JobId id) { *state += 10; });
+	ASSERT_EQ(2, state.use_count());
+	ASSERT_TRUE(s.HasSharedSchedule(-2));
+	// a subscriber cancelled from another one's callback does not fire
+	s.ScheduleSharedLambda(2, -2, crontab::Cycle(10, -1), [&s](JobId id) { s.Cancel(1); });
+	s.ScheduleSharedLambda(1, -2, crontab::Cycle(10, -1), [state](JobId id) { *state += 100; });
+	clock->Advance(10); s.Tick();
+	ASSERT_EQ(10, *state);
+	ASSERT_EQ(2, state.use_count());
+	ASSERT_FALSE(s.HasCallback(1));
+	clock->Advance(10); s.Tick();
+	ASSERT_EQ(20, *state);
+	s.Cancel(0);
+	s.Cancel(2);
+	ASSERT_EQ(1, state.use_count());
+	ASSERT_FALSE(s.HasSharedSchedule(-2));
+	ASSERT_EQ(0, s.Container().Size());
+}
+
+TEST(Scheduler, StaticSchedule) {
+	auto clock = std::make_shared<ManualClock>();
+	StaticScheduler<int, StaticTreeJobContainer, ManualClock> s(clock, std::make_shared<StaticTreeJobContainer>());
+	static_assert(std::is_same<decltype(s.Container()), StaticTreeJobContainer const&>::value, "concrete container");
+	static_assert(!std::is_final<TreeJobContainer>::value && !std::is_final<LazyClock>::value, "open for extension");
+	size_t counter = 0;
+	for (int i = 0; i < 10; ++i) {
+		s.ScheduleWithDelayLambda(i, (i + 1) * 10, [&counter](JobId id) { ++counter; });
+	}
+	s.ScheduleRepeatLambda(100, crontab::Cycle(10, 3), [&counter](JobId id) { ++counter; });
+	s.Cancel(9);
+	for (int i = 0; i < 10; ++i) {
+		clock->Advance(10); s.Tick();
+	}
+	ASSERT_EQ(12, counter);
+	ASSERT_EQ(0, s.Container().Size());
+
+	// default clock is a StaticLazyClock
+	StaticScheduler<int, StaticTreeJobContainer> lazy(new StaticTreeJobContainer());
+	static_assert(std::is_same<decltype(lazy)::clock_type, StaticLazyClock>::value, "concrete clock");
+	lazy.ScheduleWithDelayLambda(1, 10, [&counter](JobId id) { ++counter; });
+	lazy.Advance(100); lazy.Tick();
+	ASSERT_EQ(13, counter);
+}
+
+// forwards to the default resource and counts outstanding allocations
+class CountingResource : public MemoryResource {
+public:
+	size_t allocated_ = 0;
+	size_t outstanding_ = 0;
+	size_t outstandingBytes_ = 0;
+
+protected:
+	virtual void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+		++allocated_;
+		++outstanding_;
+		outstandingBytes_ += bytes;
+		return DefaultResource()->allocate(bytes, alignment);
+	}
+	virtual void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override {
+		--outstanding_;
+		outstandingBytes_ -= bytes;
+		DefaultResource()->deallocate(p, bytes, alignment);
+	}
+	virtual bool do_is_equal(MemoryResource const& other) const noexcept override {
+		return this == &other;
+	}
+};
+
+TEST(Scheduler, MemoryResource) {
+	CountingResource resource;
+	{
+		auto clock = std::make_shared<ManualClock>();
+		Scheduler<int> s(clock, std::make_shared<TreeJobContainer>(&resource), &resource);
+		size_t counter = 0;
+		for (int i = 0; i < 100; ++i) {
+			s.ScheduleWithDelayLambda(i, i + 1, [&counter](JobId id) { ++counter; });
+		}
+		s.ScheduleRepeatLambda(1000, crontab::Cycle(10, 3), [&counter](JobId id) { ++counter; });
+		// entries, wrappers and lambdas all come from the resource
+		ASSERT_LE(101 * 4, resource.allocated_);
+		auto allocated = resource.allocated_;
+		clock->Advance(50); s.Tick();
+		ASSERT_EQ(51, counter);
+		ASSERT_EQ(allocated, resource.allocated_);
+		s.Cancel(60);
+	}
+	ASSERT_EQ(0, resource.outstanding_);
+	ASSERT_EQ(0, resource.outstandingBytes_);
+}
+
+class ThrowingMove {
+public:
+	ThrowingMove() {}
+	ThrowingMove(ThrowingMove&&) { throw std::runtime_error("move"); }
+	void operator()(JobId) {}
+};
+
+TEST(Scheduler, CallbackConstructorThrows) {
+	CountingResource resource;
+	ASSERT_THROW(WrapLambdaPtr(&resource, ThrowingMove()), std::runtime_error);
+	// the block goes back with the size it was allocated with
+	ASSERT_EQ(0, resource.outstanding_);
+	ASSERT_EQ(0, resource.outstandingBytes_);
+}
+
+TEST(Scheduler, MemoryAndCompact) {
+	Scheduler<int> s(std::make_shared<ManualClock>(), std::make_shared<TreeJobContainer>());
+	auto empty = s.Memory();
+	for (int i = 0; i < 1000; ++i) {
+		s.ScheduleWithDelayLambda(i, 1000, [](JobId) {}, i % 10);
+		s.ScheduleRepeatLambda(-i - 1, crontab::Cycle(100, -1), [](JobId) {});
+	}
+	auto peak = s.Memory();
+	ASSERT_GT(peak.nodes_, empty.nodes_ + 2000 * sizeof(Job));
+	ASSERT_GE(peak.repeats_, 2000 * sizeof(crontab::RepeatConfig));
+	// wrappers and the user lambdas behind them
+	ASSERT_GE(peak.callbacks_, 2000 * 2 * sizeof(ExpireCallback));
+	ASSERT_EQ(peak.Total(), peak.nodes_ + peak.buckets_ + peak.callbacks_ + peak.repeats_ + peak.other_);
+
+	s.CancelAll();
+	ASSERT_EQ(0, s.Memory().nodes_);
+	ASSERT_EQ(peak.buckets_, s.Memory().buckets_);
+	s.Compact();
+	auto compacted = s.Memory();
+	ASSERT_LT(compacted.buckets_, peak.buckets_ / 4);
+	ASSERT_LT(compacted.Total(), peak.Total() / 4);
+
+	size_t counter = 0;
+	s.ScheduleWithDelayLambda(1, 10, [&counter](JobId) { ++counter; });
+	s.Advance(10);
+	s.Tick();
+	ASSERT_EQ(1, counter);
+}
+
 class ConstructCounter {
 public:
 	ConstructCounter(size_t& copyCount, size_t& moveCount) : copy_(copyCount), move_(moveCount) {}
@@ -0,0 +1,91 @@
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "Scheduler.hpp"
+#include "SpinDriver.hpp"
+#include "TreeJobContainer.hpp"
+
+using namespace elapse;
+
+TEST(SpinDriver, RunUntilStopped) {
+	Scheduler<int> s(new TreeJobContainer());
+	SpinDriver driver(s, *s.ClockPtr());
+	driver.SetSpinWindow(std::chrono::milliseconds(1));
+	auto step = ToTimeUnit(std::chrono::milliseconds(2));
+	size_t counter = 0;
+	for (int i = 0; i < 10; ++i) {
+		s.ScheduleWithDelayLambda(i, (i + 1) * step, [&counter, &driver](JobId id) {
+			if (++counter == 10) {
+				driver.Stop();
+			}
+		});
+	}
+	driver.Run();
+	ASSERT_EQ(10, counter);
+	ASSERT_TRUE(driver.Stopped());
+	auto latency = driver.WakeupLatency();
+	ASSERT_EQ(driver.Ticks(), latency.count_);
+	ASSERT_GE(latency.count_, 10);
+	ASSERT_LE(latency.p50_, latency.max_);
+
+	// nothing scheduled, a single bounded sleep
+	driver.ResetStats();
+	driver.SetMaxSleep(std::chrono::milliseconds(1));
+	ASSERT_FALSE(driver.RunOnce());
+	ASSERT_EQ(0, driver.WakeupLatency().count_);
+}
+
+TEST(SpinDriver, Group) {
+	auto clock = std::make_shared<Clock>();
+	SchedulerGroup group(clock);
+	Scheduler<int> a(clock, std::make_shared<TreeJobContainer>()), b(clock, std::make_shared<TreeJobContainer>());
+	group.Add(a);
+	group.Add(b);
+	SpinDriver driver(group, *clock);
+	size_t counter = 0;
+	a.ScheduleWithDelayLambda(1, ToTimeUnit(std::chrono::milliseconds(1)), [&counter](JobId id) { ++counter; });
+	b.ScheduleWithDelayLambda(1, ToTimeUnit(std::chrono::milliseconds(3)), [&counter](JobId id) { ++counter; });
+	for (int i = 0; i < 1000 && counter < 2; ++i) {
+		driver.RunOnce();
+	}
+	ASSERT_EQ(2, counter);
+	ASSERT_GE(driver.Ticks(), 2);
+}
+
+TEST(SpinDriver, FullPrecisionDeadline) {
+	auto clock = std::make_shared<Clock>();
+	Scheduler<int> s(clock, std::make_shared<TreeJobContainer>());
+	SpinDriver driver(s, *clock);
+	driver.SetSpinWindow(std::chrono::milliseconds(2));
+	auto step = ToTimeUnit(std::chrono::milliseconds(2));
+	std::vector<std::chrono::nanoseconds> lateness;
+	for (int i = 0; i < 20; ++i) {
+		auto deadline = clock->Now() + step;
+		s.ScheduleLambda(i, deadline, [&lateness, &clock, deadline](JobId id) {
+			lateness.push_back(clock->TimePoint().time_since_epoch() - TimeUnitDuration(deadline));
+		});
+		while (lateness.size() <= static_cast<size_t>(i)) {
+			driver.RunOnce();
+		}
+	}
+	// the wait used to run from the truncated Now(), overshooting by up to a unit
+	std::sort(lateness.begin(), lateness.end());
+	ASSERT_GE(lateness.front().count(), 0);
+	ASSERT_LT(lateness[lateness.size() / 2], std::chrono::duration_cast<std::chrono::nanoseconds>(TimeUnitDuration(1)) / 2);
+}
+
+TEST(SpinDriver, DomainClock) {
+	auto base = std::make_shared<Clock>();
+	auto domain = std::make_shared<DomainClock>(base);
+	Scheduler<int> s(domain, std::make_shared<TreeJobContainer>());
+	// the domain runs an hour ahead, its deadlines are still waited for in base time
+	domain->Advance(ToTimeUnit(std::chrono::hours(1)));
+	SpinDriver driver(s, *domain);
+	size_t counter = 0;
+	s.ScheduleWithDelayLambda(1, ToTimeUnit(std::chrono::milliseconds(5)), [&counter](JobId id) { ++counter; });
+	auto begin = std::chrono::steady_clock::now();
+	while (!driver.RunOnce()) {}
+	ASSERT_EQ(1, counter);
+	ASSERT_GE(std::chrono::steady_clock::now() - begin, std::chrono::milliseconds(4));
+}
\ No newline at end of file
@@ -0,0 +1,25 @@
+#pragma once
+#include <chrono>
+#include "Clock.hpp"
+
+
+namespace elapse {
+
+// clock driven only by Advance(), keeps tests independent from wall time
+class ManualClock : public Clock {
+public:
+	ManualClock() : now_(1525436318 * kTimeUnitsPerSecond) {}
+	virtual ~ManualClock() {}
+
+	virtual TimeUnit Now() const override { return now_; }
+	virtual std::time_t NowTimeT() const override { return static_cast<std::time_t>(now_ / kTimeUnitsPerSecond); }
+	virtual time_point TimePoint() const override {
+		return time_point(std::chrono::duration_cast<clock_source::duration>(TimeUnitDuration(now_)));
+	}
+	virtual void Advance(TimeOffset delta) override { now_ += delta; }
+
+private:
+	TimeUnit now_;
+};
+
+} // namespace elapse
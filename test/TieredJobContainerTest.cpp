@@ -0,0 +1,193 @@
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <map>
+#include <vector>
+#include "TieredJobContainer.hpp"
+#include "Scheduler.hpp"
+#include "TestClock.hpp"
+
+using namespace elapse;
+#define TIME_BEGIN 1525436318156L
+
+TEST(TieredContainer, FiresInOrder) {
+	TieredJobContainer ctn(1000);
+	TimeUnit now = TIME_BEGIN;
+	std::vector<JobId> fired;
+	auto cb = [&fired](JobId id) { fired.push_back(id); };
+	std::vector<std::pair<TimeUnit, JobId>> expected;
+	for (int i = 0; i < 500; ++i) {
+		auto expireTime = now + (i * 7919) % 5000;
+		expected.emplace_back(expireTime, ctn.Add(expireTime, WrapLambdaPtr(cb), i % 3));
+	}
+	std::vector<BatchJob> batch;
+	for (int i = 0; i < 100; ++i) {
+		batch.emplace_back(now + (i * 31) % 5000, WrapLambdaPtr(cb));
+	}
+	ctn.AddBatch(batch);
+	for (auto const& job : batch) {
+		expected.emplace_back(job.expire_, job.id_);
+	}
+	// the window starts with the first tick, until then every job is hot
+	ASSERT_EQ(0, ctn.Limit());
+	ASSERT_EQ(600, ctn.Hot().Size());
+	ASSERT_EQ(TIME_BEGIN, ctn.EarliestExpire());
+
+	ctn.PopExpires(now - 1);
+	ASSERT_EQ(now - 1 + 1000, ctn.Limit());
+	ASSERT_LT(ctn.Hot().Size(), 200);
+	ASSERT_EQ(TIME_BEGIN, ctn.EarliestExpire());
+	ASSERT_EQ(600, ctn.Size());
+	ASSERT_EQ(167, ctn.CountGroup(1));
+
+	for (; now < TIME_BEGIN + 5000; now += 10) {
+		ctn.PopExpires(now);
+		// the hot tier holds about a window of jobs
+		ASSERT_LT(ctn.Hot().Size(), 200);
+	}
+	ASSERT_EQ(0, ctn.Size());
+	// every job once, in expire order
+	ASSERT_EQ(expected.size(), fired.size());
+	std::map<JobId, TimeUnit> expires;
+	for (auto const& it : expected) {
+		expires[it.second] = it.first;
+	}
+	ASSERT_EQ(expected.size(), expires.size());
+	for (size_t i = 1; i < fired.size(); ++i) {
+		ASSERT_LE(expires[fired[i - 1]], expires[fired[i]]);
+	}
+	std::sort(fired.begin(), fired.end());
+	ASSERT_TRUE(std::unique(fired.begin(), fired.end()) == fired.end());
+}
+
+TEST(TieredContainer, MoveBetweenTiers) {
+	TieredJobContainer ctn(1000);
+	size_t counter = 0;
+	ctn.PopExpires(TIME_BEGIN);
+	auto near = ctn.Add(TIME_BEGIN + 10, WrapLambdaPtr([&counter](JobId) { ++counter; }), 1);
+	auto far = ctn.Add(TIME_BEGIN + 100000, WrapLambdaPtr([&counter](JobId) { ++counter; }), 1);
+	ASSERT_NE(near, far);
+	ASSERT_EQ(1, ctn.Hot().Size());
+	ASSERT_EQ(1, ctn.Cold().Size());
+
+	ASSERT_TRUE(ctn.Reschedule(near, TIME_BEGIN + 200000));
+	ASSERT_TRUE(ctn.Reschedule(far, TIME_BEGIN + 20));
+	ASSERT_EQ(1, ctn.Hot().Size());
+	ASSERT_EQ(TIME_BEGIN + 20, ctn.EarliestExpire());
+	ASSERT_EQ(1, ctn.PopExpires(TIME_BEGIN + 20));
+	ASSERT_EQ(1, counter);
+
+	// a job moved cold from its own callback survives
+	TieredJobContainer* self = &ctn;
+	JobId repeat = 0;
+	repeat = ctn.Add(TIME_BEGIN + 30, WrapLambdaPtr([self, &repeat, &counter](JobId) {
+		++counter;
+		self->Reschedule(repeat, TIME_BEGIN + 300000);
+	}));
+	ASSERT_EQ(1, ctn.PopExpires(TIME_BEGIN + 30));
+	ASSERT_EQ(2, counter);
+	ASSERT_EQ(2, ctn.Cold().Size());
+	ASSERT_EQ(TIME_BEGIN + 200000, ctn.EarliestExpire());
+
+	// a time jump promotes and fires everything due
+	ASSERT_EQ(2, ctn.PopExpires(TIME_BEGIN + 300000));
+	ASSERT_EQ(4, counter);
+	ASSERT_EQ(0, ctn.Size());
+	ASSERT_FALSE(ctn.Remove(near));
+	ASSERT_FALSE(ctn.Reschedule(far, TIME_BEGIN));
+}
+
+TEST(TieredContainer, Start) {
+	TieredJobContainer ctn(1000);
+	ctn.Start(TIME_BEGIN);
+	ASSERT_EQ(TIME_BEGIN + 1000, ctn.Limit());
+	std::vector<JobId> fired;
+	auto cb = [&fired](JobId id) { fired.push_back(id); };
+	// far jobs go straight to the cold tier, with ids from the shared counter
+	auto near = ctn.Add(TIME_BEGIN + 10, WrapLambdaPtr(cb));
+	auto far = ctn.Add(TIME_BEGIN + 5000, WrapLambdaPtr(cb), 1);
+	std::vector<BatchJob> batch;
+	batch.emplace_back(TIME_BEGIN + 6000, WrapLambdaPtr(cb));
+	batch.emplace_back(TIME_BEGIN + 20, WrapLambdaPtr(cb));
+	batch.emplace_back(TIME_BEGIN + 5000, WrapLambdaPtr(cb), 1);
+	batch.emplace_back(TIME_BEGIN + 15, WrapLambdaPtr(cb));
+	ctn.AddBatch(batch);
+	ASSERT_EQ(3, ctn.Hot().Size());
+	ASSERT_EQ(3, ctn.Cold().Size());
+	ASSERT_EQ(2, ctn.CountGroup(1));
+	std::vector<JobId> ids{near, far};
+	for (auto const& job : batch) {
+		ids.push_back(job.id_);
+	}
+	std::sort(ids.begin(), ids.end());
+	ASSERT_TRUE(std::unique(ids.begin(), ids.end()) == ids.end());
+	ASSERT_NE(0, ids.front());
+
+	// a later start splits the jobs again
+	ctn.Start(TIME_BEGIN + 5000);
+	ASSERT_EQ(5, ctn.Hot().Size());
+	ASSERT_EQ(1, ctn.Cold().Size());
+	ASSERT_EQ(5, ctn.PopExpires(TIME_BEGIN + 5000));
+	ASSERT_EQ(5, fired.size());
+	ASSERT_EQ(batch[1].id_, fired[2]);
+	ASSERT_EQ(1, ctn.PopExpires(TIME_BEGIN + 6000));
+	ASSERT_EQ(batch[0].id_, fired.back());
+}
+
+TEST(TieredContainer, GroupsAndRemoval) {
+	TieredJobContainer ctn(1000);
+	ctn.PopExpires(TIME_BEGIN);
+	auto cb = [](JobId) {};
+	std::vector<JobId> ids;
+	for (int i = 0; i < 100; ++i) {
+		ids.push_back(ctn.Add(TIME_BEGIN + 1 + i * 100, WrapLambdaPtr(cb), i % 4));
+	}
+	ctn.AddImmediate(WrapLambdaPtr(cb), 1);
+	ASSERT_EQ(26, ctn.CountGroup(1));
+	size_t nVisited = 0;
+	ctn.IterGroup(1, [&nVisited](Job const&) { return ++nVisited < 20; });
+	ASSERT_EQ(20, nVisited);
+	nVisited = 0;
+	ctn.IterJobs([&nVisited](Job const&) { return ++nVisited < 50; });
+	ASSERT_EQ(50, nVisited);
+
+	ASSERT_EQ(26, ctn.RemoveGroup(1));
+	ASSERT_EQ(2, ctn.RemoveBatch({ids[0], ids[99], ids[1]}));
+
+	// the cursor walks the hot tier, then the cold one
+	RemoveCursor cursor;
+	size_t nSteps = 0;
+	while (!cursor.Done()) {
+		ctn.RemoveJobsStep(cursor, [](Job const& job) { return job.group_ == 2; }, 10);
+		++nSteps;
+	}
+	ASSERT_EQ(25, cursor.removed_);
+	ASSERT_EQ(73, cursor.visited_);
+	ASSERT_EQ(8, nSteps);
+	ASSERT_EQ(0, ctn.CountGroup(2));
+	ASSERT_EQ(48, ctn.Size());
+
+	auto peak = ctn.Memory();
+	ctn.RemoveAll();
+	ctn.Compact();
+	ASSERT_LT(ctn.Memory().Total(), peak.Total());
+	ASSERT_EQ(0, ctn.EarliestExpire());
+}
+
+TEST(TieredContainer, Scheduler) {
+	auto clock = std::make_shared<ManualClock>();
+	Scheduler<int> s(clock, std::make_shared<TieredJobContainer>(1000));
+	size_t counter = 0;
+	for (int i = 0; i < 100; ++i) {
+		s.ScheduleRepeatLambda(i, crontab::Cycle(100 + i * 100, -1), [&counter](JobId) { ++counter; });
+	}
+	for (int i = 0; i < 10000; i += 10) {
+		s.Advance(10);
+		s.Tick();
+	}
+	size_t expected = 0;
+	for (int i = 0; i < 100; ++i) {
+		expected += 10000 / (100 + i * 100);
+	}
+	ASSERT_EQ(expected, counter);
+	ASSERT_EQ(100, s.Container().Size());
+}
\ No newline at end of file
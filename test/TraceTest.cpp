@@ -0,0 +1,145 @@
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <sstream>
+#include "Scheduler.hpp"
+#include "TreeJobContainer.hpp"
+#include "Trace.hpp"
+#include "TraceReplay.hpp"
+#include "TestClock.hpp"
+
+using namespace elapse;
+
+TEST(Trace, RoundTrip) {
+	std::stringstream ss;
+	TraceWriter writer(ss);
+	std::vector<TraceEvent> events = {
+		{TraceOp::Add, 1000, 1, 1500, 7},
+		{TraceOp::Reschedule, 1010, 1, 900, NullGroup},
+		{TraceOp::Tick, 1000, 0, 0, NullGroup},
+		{TraceOp::Fire, 1000, 1, 0, NullGroup},
+		{TraceOp::TickEnd, 1000, 0, 0, NullGroup},
+		{TraceOp::RemoveGroup, 2000, 0, 0, 7},
+		{TraceOp::Remove, 2000, 12345678901ULL, 0, NullGroup},
+	};
+	for (auto const& e : events) {
+		writer.Write(e.op_, e.time_, e.id_, e.expire_, e.group_);
+	}
+	std::vector<TraceEvent> loaded;
+	ASSERT_TRUE(LoadTrace(ss, loaded));
+	ASSERT_EQ(events, loaded);
+
+	std::stringstream bad("not a trace");
+	ASSERT_FALSE(LoadTrace(bad, loaded));
+}
+
+TEST(Trace, RecordAndReplay) {
+	std::stringstream ss;
+	auto writer = std::make_shared<TraceWriter>(ss);
+	auto clock = std::make_shared<ManualClock>();
+	auto recorder = std::make_shared<RecordingJobContainer>(std::make_shared<TreeJobContainer>(), writer, clock);
+	{
+		Scheduler<int> s(clock, recorder);
+		for (int i = 0; i < 100; ++i) {
+			s.ScheduleWithDelayLambda(i, 10 + i % 7, [&s, i](JobId id) {
+				if (i % 10 == 0) {
+					s.ScheduleWithDelayLambda(1000 + i, 5, [](JobId id) {});
+				}
+			}, i % 3);
+		}
+		s.ScheduleRepeatLambda(500, crontab::Cycle(3, 10), [](JobId id) {});
+		s.Cancel(5);
+		s.CancelGroup(2);
+		for (int i = 0; i < 30; ++i) {
+			clock->Advance(1); s.Tick();
+		}
+	}
+	ASSERT_LT(0, writer->Count());
+
+	std::vector<TraceEvent> events;
+	ASSERT_TRUE(LoadTrace(ss, events));
+	ASSERT_EQ(writer->Count(), events.size());
+	auto stats = ReplayTrace(events, [](MemoryResource* resource) {
+		return std::unique_ptr<JobContainer>(new TreeJobContainer(resource));
+	});
+	// 67 one-shot jobs survive the cancels, 7 more from their callbacks, 10 repeats
+	ASSERT_EQ(84, stats.fires_);
+	ASSERT_EQ(0, stats.missedFires_);
+	ASSERT_EQ(0, stats.extraFires_);
+	ASSERT_EQ(30, stats.ticks_);
+	ASSERT_EQ(0, stats.lateness_.max_);
+	ASSERT_EQ(101, stats.peakJobs_);
+	ASSERT_LT(0, stats.peakBytes_);
+	ASSERT_EQ(108, stats.add_.count_);
+	ASSERT_EQ(9, stats.reschedule_.count_);
+}
+
+TEST(Trace, ReplayBatched) {
+	std::stringstream ss;
+	auto writer = std::make_shared<TraceWriter>(ss);
+	auto clock = std::make_shared<ManualClock>();
+	auto recorder = std::make_shared<RecordingJobContainer>(std::make_shared<TreeJobContainer>(), writer, clock);
+	{
+		Scheduler<int> s(clock, recorder);
+		// every batch schedules one more job from the sink
+		class RearmSink : public BatchAliasCallback<int> {
+		public:
+			explicit RearmSink(Scheduler<int>& s) : s_(s) {}
+			virtual void operator()(int const* aliases, size_t count) override {
+				s_.ScheduleWithDelayLambda(1000 + aliases[0], 3, [](JobId id) {});
+			}
+
+		private:
+			Scheduler<int>& s_;
+		} sink(s);
+		for (int i = 0; i < 20; ++i) {
+			s.ScheduleBatched(i, clock->Now() + 5 + i % 4, &sink, i % 2);
+		}
+		s.ScheduleWithDelayLambda(100, 6, [](JobId id) {});
+		for (int i = 0; i < 15; ++i) {
+			clock->Advance(1); s.Tick();
+		}
+	}
+	std::vector<TraceEvent> events;
+	ASSERT_TRUE(LoadTrace(ss, events));
+	// batched jobs are logged as they reach the sink
+	ASSERT_EQ(20, std::count_if(events.begin(), events.end(), [](TraceEvent const& e) {
+		return e.op_ == TraceOp::Fire && e.id_ <= 20;
+	}));
+	auto stats = ReplayTrace(events, [](MemoryResource* resource) {
+		return std::unique_ptr<JobContainer>(new TreeJobContainer(resource));
+	});
+	// 20 batched, 1 plain and one job from each of the 4 batches
+	ASSERT_EQ(25, stats.fires_);
+	ASSERT_EQ(0, stats.missedFires_);
+	ASSERT_EQ(0, stats.extraFires_);
+	ASSERT_EQ(25, stats.lateness_.count_);
+	ASSERT_EQ(25, stats.add_.count_);
+}
+
+TEST(Trace, ReplayAccounting) {
+	auto factory = [](MemoryResource* resource) {
+		return std::unique_ptr<JobContainer>(new TreeJobContainer(resource));
+	};
+	std::vector<TraceEvent> events = {
+		{TraceOp::Add, 1000, 1, 1010, 7},
+		{TraceOp::Add, 1000, 2, 1010, NullGroup},
+		{TraceOp::AddBatched, 1000, 3, 1010, 7},
+		{TraceOp::AddBatched, 1000, 4, 1010, NullGroup},
+		{TraceOp::AddBatched, 1000, 5, 1020, NullGroup},
+		{TraceOp::RemoveGroup, 1005, 0, 0, 7},
+		// gone with the group, not replayed
+		{TraceOp::Remove, 1006, 1, 0, NullGroup},
+		{TraceOp::Remove, 1006, 3, 0, NullGroup},
+		// job 4 fires without a trace record, job 5 is recorded early
+		{TraceOp::Tick, 1010, 0, 0, NullGroup},
+		{TraceOp::Fire, 1010, 2, 0, NullGroup},
+		{TraceOp::Fire, 1010, 5, 0, NullGroup},
+		{TraceOp::TickEnd, 1010, 0, 0, NullGroup},
+	};
+	auto stats = ReplayTrace(events, factory);
+	ASSERT_EQ(1, stats.remove_.count_);
+	ASSERT_EQ(2, stats.fires_);
+	ASSERT_EQ(1, stats.missedFires_);
+	ASSERT_EQ(1, stats.extraFires_);
+	ASSERT_EQ(5, stats.peakJobs_);
+}
\ No newline at end of file
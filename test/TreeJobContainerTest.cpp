@@ -50,6 +50,149 @@ TEST(TreeContainer, Remove) {
 	ASSERT_EQ(0, ctn.PopExpires(1000));
 }
 
+TEST(TreeContainer, Reschedule) {
+	TreeJobContainer ctn;
+	size_t counter = 0;
+	JobId jobId = 0;
+	jobId = ctn.Add(10, WrapLambdaPtr([&ctn, &counter, &jobId](JobId id) {
+		++counter;
+		if (counter < 3) {
+			ASSERT_TRUE(ctn.Reschedule(jobId, 10 + counter * 10));
+		}
+	}));
+
+	ASSERT_FALSE(ctn.Reschedule(jobId + 1, 5));
+	ASSERT_TRUE(ctn.Reschedule(jobId, 5));
+	ASSERT_EQ(0, ctn.PopExpires(4));
+	ASSERT_EQ(1, ctn.PopExpires(5));
+	ASSERT_EQ(1, ctn.Size());
+	ASSERT_EQ(0, ctn.PopExpires(19));
+	ASSERT_EQ(1, ctn.PopExpires(20));
+	ASSERT_EQ(1, ctn.PopExpires(30));
+	ASSERT_EQ(0, ctn.Size());
+	ASSERT_EQ(3, counter);
+}
+
+TEST(TreeContainer, Batch) {
+	TreeJobContainer ctn;
+	std::vector<TimeUnit> fired;
+	ctn.Add(25, WrapLambdaPtr([&fired](JobId id) { fired.push_back(25); }));
+	std::vector<BatchJob> batch;
+	for (TimeUnit expire : {30, 10, 20, 10, 40}) {
+		batch.emplace_back(expire, WrapLambdaPtr([&fired, expire](JobId id) { fired.push_back(expire); }));
+	}
+	ctn.AddBatch(batch);
+	ASSERT_EQ(6, ctn.Size());
+	ASSERT_EQ(10, ctn.EarliestExpire());
+	ASSERT_NE(batch[1].id_, batch[3].id_);
+	ASSERT_EQ(2, ctn.RemoveBatch({batch[0].id_, batch[4].id_, 12345}));
+	ctn.PopExpires(100);
+	ASSERT_EQ((std::vector<TimeUnit>{10, 10, 20, 25}), fired);
+}
+
+class CollectSink : public BatchExpireCallback {
+public:
+	virtual void operator()(JobId const* ids, size_t count) override {
+		calls_.emplace_back(ids, ids + count);
+	}
+
+	std::vector<std::vector<JobId>> calls_;
+};
+
+TEST(TreeContainer, BatchSink) {
+	TreeJobContainer ctn;
+	CollectSink sink1, sink2;
+	size_t nFired = 0;
+	std::vector<JobId> ids1, ids2;
+	for (TimeUnit expire = 1; expire <= 10; ++expire) {
+		ids1.push_back(ctn.AddBatched(expire, &sink1, NullGroup));
+		ids2.push_back(ctn.AddBatched(expire, &sink2, NullGroup));
+		ctn.Add(expire, WrapLambdaPtr([&nFired, &sink1](JobId id) {
+			// per-job callbacks run before the sinks
+			ASSERT_TRUE(sink1.calls_.empty() || sink1.calls_.size() == 1);
+			++nFired;
+		}));
+	}
+	ctn.Remove(ids1[9]);
+	ASSERT_EQ(15, ctn.PopExpires(5));
+	ASSERT_EQ(5, nFired);
+	ASSERT_EQ(1, sink1.calls_.size());
+	ASSERT_EQ(std::vector<JobId>(ids1.begin(), ids1.begin() + 5), sink1.calls_[0]);
+	ASSERT_EQ(std::vector<JobId>(ids2.begin(), ids2.begin() + 5), sink2.calls_[0]);
+	ASSERT_EQ(14, ctn.PopExpires(10));
+	ASSERT_EQ(std::vector<JobId>(ids1.begin() + 5, ids1.begin() + 9), sink1.calls_[1]);
+	ASSERT_EQ(2, sink2.calls_.size());
+	ASSERT_EQ(0, ctn.Size());
+}
+
+TEST(TreeContainer, Immediate) {
+	TreeJobContainer ctn;
+	std::vector<int> fired;
+	ctn.Add(5, WrapLambdaPtr([&fired](JobId id) { fired.push_back(0); }));
+	for (int i = 1; i <= 3; ++i) {
+		ctn.AddImmediate(WrapLambdaPtr([&fired, &ctn, i](JobId id) {
+			fired.push_back(i);
+			// re-queued jobs wait for the next call
+			ctn.AddImmediate(WrapLambdaPtr([&fired, i](JobId id) { fired.push_back(i * 10); }), 7);
+		}), NullGroup);
+	}
+	auto removed = ctn.AddImmediate(WrapLambdaPtr([&fired](JobId id) { fired.push_back(-1); }), 7);
+	ASSERT_EQ(5, ctn.Size());
+	ASSERT_EQ(1, ctn.EarliestExpire());
+	ASSERT_EQ(1, ctn.CountGroup(7));
+	ASSERT_TRUE(ctn.Remove(removed));
+	ASSERT_FALSE(ctn.Reschedule(removed, 10));
+	ASSERT_EQ(3, ctn.PopExpires(1));
+	ASSERT_EQ((std::vector<int>{1, 2, 3}), fired);
+	ASSERT_EQ(3, ctn.CountGroup(7));
+	ASSERT_EQ(4, ctn.PopExpires(5));
+	ASSERT_EQ((std::vector<int>{1, 2, 3, 10, 20, 30, 0}), fired);
+	ASSERT_EQ(0, ctn.Size());
+	ASSERT_EQ(0, ctn.EarliestExpire());
+}
+
+TEST(TreeContainer, RescheduleImmediate) {
+	TreeJobContainer ctn;
+	size_t counter = 0;
+	auto moved = ctn.AddImmediate(WrapLambdaPtr([&counter](JobId id) { ++counter; }), 7);
+	// a firing immediate job moving itself fires again at its new time
+	JobId self = 0;
+	self = ctn.AddImmediate(WrapLambdaPtr([&counter, &ctn, &self](JobId id) {
+		++counter;
+		ASSERT_TRUE(ctn.Reschedule(self, 20));
+	}), NullGroup);
+	ASSERT_TRUE(ctn.Reschedule(moved, 10));
+	ASSERT_EQ(1, ctn.CountGroup(7));
+	ASSERT_EQ(2, ctn.Size());
+	ASSERT_EQ(1, ctn.PopExpires(1));
+	ASSERT_EQ(1, counter);
+	ASSERT_EQ(2, ctn.Size());
+	ASSERT_EQ(10, ctn.EarliestExpire());
+	ASSERT_EQ(1, ctn.PopExpires(10));
+	ASSERT_EQ(2, counter);
+	ASSERT_EQ(1, ctn.PopExpires(20));
+	ASSERT_EQ(3, counter);
+	ASSERT_EQ(0, ctn.Size());
+}
+
+TEST(TreeContainer, Group) {
+	TreeJobContainer ctn;
+	auto cb = [](JobId id) {};
+	for (int i = 0; i < 10; ++i) {
+		ctn.Add(i, WrapLambdaPtr(cb), i % 2 ? 7 : NullGroup);
+	}
+	ASSERT_EQ(5, ctn.CountGroup(7));
+	size_t counter = 0;
+	ctn.IterGroup(7, [&counter](Job const& job) { ++counter; return job.group_ == 7; });
+	ASSERT_EQ(5, counter);
+
+	ASSERT_EQ(5, ctn.RemoveGroup(7));
+	ASSERT_EQ(0, ctn.CountGroup(7));
+	ASSERT_EQ(0, ctn.RemoveGroup(7));
+	ASSERT_EQ(5, ctn.Size());
+	ASSERT_EQ(5, ctn.PopExpires(100));
+}
+
 TEST(TreeContainer, Iterate) {
 	TreeJobContainer ctn;
 	auto cb = [](JobId id) {};
@@ -95,6 +238,115 @@ TEST(TreeContainer, RemoveIf) {
 	ASSERT_EQ(0, ctn.Size());
 }
 
+TEST(TreeContainer, RemoveIfIncremental) {
+	TreeJobContainer ctn;
+	size_t nFired = 0;
+	auto cb = [&nFired](JobId id) { ++nFired; };
+	for (int i = 0; i < 1000; ++i) {
+		ctn.Add(i / 10 + 1, WrapLambdaPtr(cb), i % 2);
+	}
+	ctn.AddImmediate(WrapLambdaPtr(cb), 1);
+	ctn.AddImmediate(WrapLambdaPtr(cb), 0);
+
+	auto odd = [](Job const& job) { return job.group_ == 1; };
+	RemoveCursor cursor;
+	ASSERT_EQ(1, ctn.RemoveJobsStep(cursor, odd, 1));
+	ASSERT_EQ(RemoveCursor::kImmediates, cursor.phase_);
+	ASSERT_EQ(0, ctn.RemoveJobsStep(cursor, odd, 1));
+	ASSERT_EQ(1001, ctn.Size());
+	size_t nSteps = 0;
+	TimeUnit now = 0;
+	while (!cursor.Done()) {
+		ASSERT_LE(ctn.RemoveJobsStep(cursor, odd, 100), 100);
+		// jobs fire and get added between steps
+		ctn.PopExpires(++now);
+		ctn.Add(now + 200, WrapLambdaPtr(cb), 1);
+		++nSteps;
+	}
+	ASSERT_EQ(11, nSteps);
+	// jobs added ahead of the cursor were visited, only the last one is left
+	ASSERT_EQ(1, ctn.CountGroup(1));
+	ASSERT_GE(cursor.visited_, cursor.removed_ + ctn.CountGroup(0));
+	// every even job is kept, fired or pending
+	ctn.RemoveJobs(odd);
+	ASSERT_EQ(501, nFired + ctn.Size());
+	ASSERT_EQ(ctn.Size(), ctn.CountGroup(0));
+
+	// resumes at the expire time of a vanished job, once done stays done
+	cursor.Reset();
+	ctn.RemoveJobsStep(cursor, odd, 1);
+	ctn.Remove(cursor.next_);
+	ctn.RemoveJobsFor(cursor, [](Job const&) { return true; }, std::chrono::seconds(10), 16);
+	ASSERT_TRUE(cursor.Done());
+	ASSERT_EQ(0, ctn.Size());
+	ASSERT_EQ(0, ctn.RemoveJobsStep(cursor, odd, 100));
+}
+
+class IdSink : public BatchExpireCallback {
+public:
+	virtual void operator()(JobId const* ids, size_t count) override {
+		ids_.insert(ids_.end(), ids, ids + count);
+	}
+
+	std::vector<JobId> ids_;
+};
+
+TEST(TreeContainer, InterleavedSinks) {
+	TreeJobContainer ctn;
+	std::vector<IdSink> sinks(50);
+	std::vector<std::vector<JobId>> expected(sinks.size());
+	for (int i = 0; i < 1000; ++i) {
+		auto n = (i * 7) % sinks.size();
+		auto id = ctn.AddBatched(i + 1, &sinks[n], NullGroup);
+		// ids of sink 1 collected before its removal are dropped
+		if (n != 1 || i >= 500) {
+			expected[n].push_back(id);
+		}
+	}
+	ctn.Add(500, WrapLambdaPtr([&ctn, &sinks](JobId) { ctn.RemoveSink(&sinks[1]); }));
+	ASSERT_EQ(1001, ctn.PopExpires(1000));
+	for (size_t n = 0; n < sinks.size(); ++n) {
+		ASSERT_EQ(expected[n], sinks[n].ids_);
+	}
+
+	ctn.Compact();
+	ctn.AddBatched(1500, &sinks[2], NullGroup);
+	ASSERT_EQ(1, ctn.PopExpires(2000));
+	ASSERT_EQ(expected[2].size() + 1, sinks[2].ids_.size());
+}
+
+TEST(TreeContainer, MemoryAndCompact) {
+	TreeJobContainer ctn;
+	auto empty = ctn.Memory();
+	ASSERT_EQ(0, empty.nodes_);
+	ASSERT_EQ(0, empty.callbacks_);
+
+	std::vector<JobId> ids;
+	for (int i = 0; i < 2000; ++i) {
+		ids.push_back(ctn.Add(i + 1, WrapLambdaPtr([](JobId) {}), i % 100));
+	}
+	auto peak = ctn.Memory();
+	ASSERT_GE(peak.nodes_, 2000 * sizeof(Job));
+	ASSERT_GE(peak.callbacks_, 2000 * sizeof(ExpireCallback));
+	ASSERT_GT(peak.buckets_, 2000 * sizeof(void*));
+	ASSERT_EQ(peak.nodes_ + peak.buckets_ + peak.callbacks_ + peak.repeats_ + peak.other_, peak.Total());
+
+	ids.resize(1990);
+	ASSERT_EQ(1990, ctn.RemoveBatch(ids));
+	auto drained = ctn.Memory();
+	ASSERT_LT(drained.nodes_, peak.nodes_ / 100);
+	// buckets stay at peak until compacted
+	ASSERT_EQ(peak.buckets_, drained.buckets_);
+	ctn.Compact();
+	auto compacted = ctn.Memory();
+	ASSERT_LT(compacted.buckets_, peak.buckets_ / 4);
+	ASSERT_EQ(drained.nodes_, compacted.nodes_);
+
+	// still works after compaction
+	ASSERT_EQ(10, ctn.Size());
+	ASSERT_EQ(10, ctn.PopExpires(2000));
+}
+
 
 #ifdef BENCHMARK_ASIO_JOB_CONTAINER
 TEST(Scheduler, BenchTreeJobContainer) {
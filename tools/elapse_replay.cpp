@@ -0,0 +1,73 @@
+/*
+Author: ywx217@gmail.com
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include "TraceReplay.hpp"
+#include "TieredJobContainer.hpp"
+#include "TreeJobContainer.hpp"
+
+using namespace elapse;
+
+// replays a recorded workload trace against a container implementation:
+//   elapse_replay <trace file> [container]
+int main(int argc, char** argv) {
+	std::map<std::string, ContainerFactory> containers;
+	containers["tree"] = [](MemoryResource* resource) {
+		return std::unique_ptr<JobContainer>(new TreeJobContainer(resource));
+	};
+	containers["tiered"] = [](MemoryResource* resource) {
+		return std::unique_ptr<JobContainer>(new TieredJobContainer(60 * kTimeUnitsPerSecond, resource));
+	};
+
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0] << " <trace file> [container]" << std::endl << "containers:";
+		for (auto const& it : containers) {
+			std::cerr << " " << it.first;
+		}
+		std::cerr << std::endl;
+		return 1;
+	}
+	std::ifstream is(argv[1], std::ios::binary);
+	std::vector<TraceEvent> events;
+	if (!is || !LoadTrace(is, events)) {
+		std::cerr << "not a trace file: " << argv[1] << std::endl;
+		return 1;
+	}
+	auto name = argc > 2 ? std::string(argv[2]) : std::string("tree");
+	auto it = containers.find(name);
+	if (it == containers.end()) {
+		std::cerr << "unknown container: " << name << std::endl;
+		return 1;
+	}
+	std::cout << "container=" << name << std::endl;
+	PrintReplayStats(std::cout, ReplayTrace(events, it->second));
+	return 0;
+}
\ No newline at end of file